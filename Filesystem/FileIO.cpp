@@ -2,7 +2,14 @@
 #include "FilesystemCommon.h"
 #include "Filesystem.h"
 
-STORAGE::IO::FileIO::FileIO(STORAGE::Filesystem *fs_, File file_) : fs(fs_), file(file_) {
+std::atomic<size_t> STORAGE::IO::bytesWritten(0);
+std::atomic<size_t> STORAGE::IO::numWrites(0);
+std::atomic<size_t> STORAGE::IO::bytesRead(0);
+std::atomic<size_t> STORAGE::IO::numReads(0);
+std::atomic<double> STORAGE::IO::writeTime(0);
+std::atomic<double> STORAGE::IO::readTime(0);
+
+STORAGE::IO::FileIO::FileIO(STORAGE::Filesystem *fs_, File file_) : fs(fs_), file(file_), position(0) {
 	lastHeader = fs->dir->headers[file];
 }
 
@@ -28,14 +28,15 @@ namespace STORAGE {
 			}
 		}
 
-		// Statics used by the filesystem
+		// Statics used by the filesystem.  The counters are defined once, in FileIO.cpp, so that the readers and
+		// writers that bump them and Filesystem::count that reports them share the same ones.
 		static const bool timingEnabled = true;
-		static std::atomic<size_t> bytesWritten;								// Count of number of bytes written
-		static std::atomic<size_t> numWrites;									// Count of number of write operations
-		static std::atomic<size_t> bytesRead;									// Count of number of bytes read
-		static std::atomic<size_t> numReads;									// Count of number of read operations
-		static std::atomic<double> writeTime;									// Sum of write durations
-		static std::atomic<double> readTime;									// Sum of read durations
+		extern std::atomic<size_t> bytesWritten;								// Count of number of bytes written
+		extern std::atomic<size_t> numWrites;									// Count of number of write operations
+		extern std::atomic<size_t> bytesRead;									// Count of number of bytes read
+		extern std::atomic<size_t> numReads;									// Count of number of read operations
+		extern std::atomic<double> writeTime;									// Sum of write durations
+		extern std::atomic<double> readTime;									// Sum of read durations
 
 		enum StartLocation {
 			BEGIN,
@@ -71,6 +72,30 @@ namespace STORAGE {
 				return "Attempted to read beyond the end of the file or before the beginning of the file.";
 			}
 		};
+
+		class BadStreamException : public std::exception {
+			virtual const char* what() const throw() {
+				return "Attempted to open a stream on a file that is not a stream manifest.";
+			}
+		};
+
+		class FileNotFoundException : public std::exception {
+			virtual const char* what() const throw() {
+				return "Attempted to read a file that does not exist or has never been written.";
+			}
+		};
+
+		class BadDocumentException : public std::exception {
+			virtual const char* what() const throw() {
+				return "Attempted to write invalid JSON or to read a file that does not hold a valid document.";
+			}
+		};
+
+		class DirectoryFullException : public std::exception {
+			virtual const char* what() const throw() {
+				return "Attempted to create more files than the file directory can hold.";
+			}
+		};
 	}
 }
 #endif
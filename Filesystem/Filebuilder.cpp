@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+#include "Filebuilder.h"
+#include "FilesystemCommon.h"
+#include "Filesystem.h"
+
+STORAGE::IO::StoreBuilder::StoreBuilder(bool sorted_) : sorted(sorted_), total(0) {}
+
+void STORAGE::IO::StoreBuilder::add(const std::string &name, const char *value, FileSize size) {
+	char *at = place(name, size);
+	if (size) {
+		memcpy(at, value, size);
+	}
+}
+
+// Store the value as a tape, as a DocumentWriter would
+void STORAGE::IO::StoreBuilder::add(const std::string &name, JsonValue value) {
+	jsonTapeEncode(value, place(name, jsonTapeSize(value)));
+}
+
+size_t STORAGE::IO::StoreBuilder::count() {
+	return entries.size();
+}
+
+// The size of the store once it is built
+FileSize STORAGE::IO::StoreBuilder::size() {
+	return FileDirectory::SIZE + total;
+}
+
+// Make room for a value and point its name at it.  A replaced value is not written, but keeps its memory.
+char *STORAGE::IO::StoreBuilder::place(const std::string &name, FileSize size) {
+	if (name.empty() || name.size() >= FileHeader::MAXNAMELEN) {
+		throw std::invalid_argument("file name empty or too long");
+	}
+	if (size > MaxFileSize - FileHeader::SIZE) {
+		throw std::length_error("file too large to write at once");
+	}
+
+	auto it = names.find(name);
+	bool created = it == names.end();
+	if (created && entries.size() >= MAXFILES) {
+		throw DirectoryFullException();
+	}
+	FileSize after = total + size + (created ? FileHeader::SIZE : 0) - (created ? 0 : entries[it->second].size);
+	if (FileDirectory::SIZE + after + HEADER_SIZE > maxSize) {
+		throw std::length_error("store too large for its backing file");
+	}
+
+	if (created) {
+		it = names.emplace(name, entries.size()).first;
+		entries.push_back(Entry{ name, 0, 0 });
+	}
+	Entry &entry = entries[it->second];
+	entry.offset = data.size();
+	entry.size = size;
+	total = after;
+
+	data.resize(data.size() + size);
+	return data.data() + entry.offset;
+}
+
+// Write every file into a new store.  The files go out in batches of about WRITE_SIZE bytes, which follow each
+// other, so the store is one packed run of files.  The builder is empty again afterwards.
+void STORAGE::IO::StoreBuilder::build(const char *path) {
+	if (fileExists(path)) {
+		throw std::invalid_argument("backing file already exists");
+	}
+
+	std::vector<size_t> order(entries.size());
+	std::iota(order.begin(), order.end(), 0);
+	if (sorted) {
+		std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+			return entries[a].name < entries[b].name;
+		});
+	}
+
+	Filesystem fs(path);
+	std::vector<char> batch;
+	std::vector<BatchEntry> written;
+	try {
+		fs.file.reserve(size());
+		batch.reserve(total < WRITE_SIZE ? total : WRITE_SIZE);
+
+		for (size_t i : order) {
+			const Entry &entry = entries[i];
+			if (!batch.empty() && batch.size() + FileHeader::SIZE + entry.size > WRITE_SIZE) {
+				fs.writeBatch(batch, written);
+				batch.clear();
+				written.clear();
+			}
+			FilePosition at = batch.size();
+			batch.resize(at + FileHeader::SIZE + entry.size);
+			if (entry.size) {
+				memcpy(batch.data() + at + FileHeader::SIZE, data.data() + entry.offset, entry.size);
+			}
+			written.push_back(BatchEntry{ at, entry.size, entry.name });
+		}
+		if (!batch.empty()) {
+			fs.writeBatch(batch, written);
+		}
+	} catch (...) {
+		fs.shutdown();
+		throw;
+	}
+
+	// Writes the directory
+	fs.shutdown();
+
+	std::vector<char>().swap(data);
+	std::vector<Entry>().swap(entries);
+	names.clear();
+	total = 0;
+}
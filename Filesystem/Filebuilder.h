@@ -0,0 +1,67 @@
+#ifndef _FILEBUILDER_H_
+#define _FILEBUILDER_H_
+#pragma once
+
+#include "RapidStashCommon.h"
+#include "FilesystemCommon.h"
+#include "FileIOCommon.h"
+
+#include <gason.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Offline construction of a whole store.  Files are collected in memory and written out in one pass into a new
+ * backing file: the map is grown once to its final size, every header is followed directly by its data with no
+ * room left over, and the directory is written once at the end.  Ordering the files by name puts files with
+ * neighbouring names next to each other in the backing file.  The result is an ordinary store.
+
+Built store structure:
+[File Directory]
+[Files] -- By name, or in the order they were first added
+	...
+	{ File
+		[File header] -- Version 0, no previous version
+		[File data]
+	}
+	...
+*/
+
+namespace STORAGE {
+	namespace IO {
+
+		/*
+		*  Store builder class.
+		*  Collects (name, value) pairs and builds a new store out of them.  Adding a name again replaces its
+		*  value.  Values are held in memory until build() writes them, so the builder needs about as much memory
+		*  as the store it builds.  build() refuses to write over an existing backing file.
+		*/
+		class StoreBuilder {
+		public:
+			static const FileSize WRITE_SIZE = 1 << 26;	// Bytes of files written at a time
+
+			StoreBuilder(bool = true);
+			void add(const std::string &, const char *, FileSize);
+			void add(const std::string &, JsonValue);
+			size_t count();
+			FileSize size();
+			void build(const char *);
+		private:
+			char *place(const std::string &, FileSize);
+
+			struct Entry {
+				std::string name;
+				FilePosition offset;	// Of the value in data
+				FileSize size;
+			};
+
+			bool sorted;						// Order files by name rather than by when they were added
+			std::vector<char> data;				// Every value added, back to back
+			std::vector<Entry> entries;
+			std::unordered_map<std::string, size_t> names;	// Name to entry
+			FileSize total;						// Size of the files once written, headers included
+		};
+	}
+}
+#endif
@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "Filecolumn.h"
+#include "Filedocument.h"
+#include "FilesystemCommon.h"
+#include "Filesystem.h"
+
+// SSE2 is always there on x64
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define COLUMN_SSE2 1
+#else
+#define COLUMN_SSE2 0
+#endif
+
+static const unsigned int NEVER = std::numeric_limits<unsigned int>::max();	// The stamp of a file that has to be loaded
+
+// Count, sum, min and max of the values whose bits are set.  Words with every bit set (which is most of them in a
+// column that most documents have) are aggregated eight values at a time with SSE2, others a value at a time.
+static void aggregateNumbers(const double *values, const uint64_t *valid, size_t words, STORAGE::IO::Aggregate &result) {
+	double sum = 0, lo = result.min, hi = result.max;
+	size_t count = 0;
+
+#if COLUMN_SSE2
+	// Four of each accumulator, so that consecutive adds do not wait on each other
+	__m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd(), s2 = _mm_setzero_pd(), s3 = _mm_setzero_pd();
+	__m128d l0 = _mm_set1_pd(lo), l1 = l0, l2 = l0, l3 = l0;
+	__m128d h0 = _mm_set1_pd(hi), h1 = h0, h2 = h0, h3 = h0;
+#endif
+
+	for (size_t w = 0; w < words; ++w) {
+		uint64_t bits = valid[w];
+		const double *v = values + w * 64;
+		if (bits == ~0ULL) {
+#if COLUMN_SSE2
+			for (int i = 0; i < 64; i += 8) {
+				__m128d x0 = _mm_loadu_pd(v + i), x1 = _mm_loadu_pd(v + i + 2), x2 = _mm_loadu_pd(v + i + 4), x3 = _mm_loadu_pd(v + i + 6);
+				s0 = _mm_add_pd(s0, x0);
+				s1 = _mm_add_pd(s1, x1);
+				s2 = _mm_add_pd(s2, x2);
+				s3 = _mm_add_pd(s3, x3);
+				l0 = _mm_min_pd(l0, x0);
+				l1 = _mm_min_pd(l1, x1);
+				l2 = _mm_min_pd(l2, x2);
+				l3 = _mm_min_pd(l3, x3);
+				h0 = _mm_max_pd(h0, x0);
+				h1 = _mm_max_pd(h1, x1);
+				h2 = _mm_max_pd(h2, x2);
+				h3 = _mm_max_pd(h3, x3);
+			}
+#else
+			for (int i = 0; i < 64; ++i) {
+				sum += v[i];
+				lo = std::min(lo, v[i]);
+				hi = std::max(hi, v[i]);
+			}
+#endif
+			count += 64;
+		} else if (bits != 0) {
+			for (int i = 0; i < 64; ++i) {
+				if (bits >> i & 1) {
+					sum += v[i];
+					lo = std::min(lo, v[i]);
+					hi = std::max(hi, v[i]);
+					count++;
+				}
+			}
+		}
+	}
+
+#if COLUMN_SSE2
+	__m128d s = _mm_add_pd(_mm_add_pd(s0, s1), _mm_add_pd(s2, s3));
+	__m128d l = _mm_min_pd(_mm_min_pd(l0, l1), _mm_min_pd(l2, l3));
+	__m128d h = _mm_max_pd(_mm_max_pd(h0, h1), _mm_max_pd(h2, h3));
+	sum += _mm_cvtsd_f64(s) + _mm_cvtsd_f64(_mm_unpackhi_pd(s, s));
+	lo = std::min(lo, std::min(_mm_cvtsd_f64(l), _mm_cvtsd_f64(_mm_unpackhi_pd(l, l))));
+	hi = std::max(hi, std::max(_mm_cvtsd_f64(h), _mm_cvtsd_f64(_mm_unpackhi_pd(h, h))));
+#endif
+
+	result.count += count;
+	result.sum += sum;
+	result.min = lo;
+	result.max = hi;
+}
+
+// The same, into one aggregate per key code
+static void aggregateGroups(const double *values, const uint64_t *valid, const uint32_t *codes, size_t words, STORAGE::IO::Aggregate *groups) {
+	for (size_t w = 0; w < words; ++w) {
+		uint64_t bits = valid[w];
+		if (bits == 0) {
+			continue;
+		}
+		for (int i = 0; i < 64; ++i) {
+			if (bits >> i & 1) {
+				size_t f = w * 64 + i;
+				STORAGE::IO::Aggregate &group = groups[codes[f]];
+				group.count++;
+				group.sum += values[f];
+				group.min = std::min(group.min, values[f]);
+				group.max = std::max(group.max, values[f]);
+			}
+		}
+	}
+}
+
+STORAGE::IO::ColumnCache::ColumnCache(STORAGE::Filesystem *fs_) : fs(fs_) {}
+
+void STORAGE::IO::ColumnCache::add(const std::string &path, ColumnType type) {
+	std::lock_guard<std::mutex> lk(lock);
+	auto it = columns.find(path);
+	if (it != columns.end() && it->second.type == type) {
+		return;
+	}
+	Column column;
+	column.type = type;
+	columns[path] = column;
+
+	// The new column has nothing in it yet
+	stamps.assign(stamps.size(), NEVER);
+}
+
+STORAGE::IO::Aggregate STORAGE::IO::ColumnCache::aggregate(const std::string &path) {
+	std::lock_guard<std::mutex> lk(lock);
+	Column &column = find(path, NUMBERS);
+	refresh();
+
+	Aggregate result;
+	aggregateNumbers(column.values.data(), column.valid.data(), column.valid.size(), result);
+	return result;
+}
+
+// Aggregate one column by the keys in another.  Files without a key are left out, and so are keys that no file
+// with a number has.
+std::map<std::string, STORAGE::IO::Aggregate> STORAGE::IO::ColumnCache::aggregate(const std::string &path, const std::string &keyPath) {
+	std::lock_guard<std::mutex> lk(lock);
+	Column &column = find(path, NUMBERS);
+	Column &keyColumn = find(keyPath, KEYS);
+	refresh();
+
+	std::vector<Aggregate> groups(keys.size() + 1);
+	aggregateGroups(column.values.data(), column.valid.data(), keyColumn.codes.data(), column.valid.size(), groups.data());
+
+	std::map<std::string, Aggregate> result;
+	for (size_t code = 1; code < groups.size(); ++code) {
+		if (groups[code].count > 0) {
+			result[keys[code - 1]] = groups[code];
+		}
+	}
+	return result;
+}
+
+STORAGE::IO::ColumnCache::Column &STORAGE::IO::ColumnCache::find(const std::string &path, ColumnType type) {
+	auto it = columns.find(path);
+	if (it == columns.end() || it->second.type != type) {
+		throw std::invalid_argument("column not registered: " + path);
+	}
+	return it->second;
+}
+
+// Reload every file whose change count moved since it was loaded, in blocks spread over the thread pool
+void STORAGE::IO::ColumnCache::refresh() {
+	if (columns.empty()) {
+		return;
+	}
+
+	// Columns are padded to a whole bitmap word, and anything past the last file is empty
+	File n = fs->dir->numFiles;
+	size_t padded = ((size_t)n + 63) / 64 * 64;
+	stamps.resize(padded, NEVER);
+	std::fill(stamps.begin() + n, stamps.end(), NEVER);
+	for (auto &entry : columns) {
+		Column &column = entry.second;
+		if (column.type == NUMBERS) {
+			column.values.resize(padded, 0);
+			column.valid.resize(padded / 64, 0);
+			if (n % 64 != 0) {
+				column.valid.back() &= (1ULL << (n % 64)) - 1;
+			}
+		} else {
+			column.codes.resize(padded, 0);
+			std::fill(column.codes.begin() + n, column.codes.end(), 0);
+		}
+	}
+
+	fs->parallelFor((padded + BLOCK - 1) / BLOCK, [&](size_t block) {
+		PooledAllocator allocator;
+		std::vector<char> buffer;
+		File last = (File)std::min<size_t>(n, (block + 1) * BLOCK);
+		for (File f = (File)(block * BLOCK); f < last; ++f) {
+			unsigned int stamp = fs->dir->changes[f];
+			if (stamps[f] == stamp) {
+				continue;
+			}
+
+			// Files that were never written hold nothing, and cannot be locked for reading under MVCC
+			if (fs->dir->headers[f].version == -1) {
+				load(f, JsonCursor(), *allocator);
+				stamps[f] = stamp;
+				continue;
+			}
+
+			FileSize size;
+			bool settled;
+			fs->lock(f, SHARED);
+			try {
+				// A file being written under MVCC is read at its previous version, so it is loaded again next time
+				stamp = fs->dir->changes[f];
+				settled = !fs->hasWriter(f);
+				Reader reader = fs->getReader(f);
+				size = reader.remaining();
+				buffer.resize(size);
+				reader.read(buffer.data(), size);
+			} catch (...) {
+				fs->unlock(f, SHARED);
+				throw;
+			}
+			fs->unlock(f, SHARED);
+
+			load(f, JsonCursor(buffer.data(), size), *allocator);
+			allocator->reset();
+			stamps[f] = settled ? stamp : NEVER;
+		}
+	});
+}
+
+// Pull every column's field out of a document, without parsing more of it than the fields
+void STORAGE::IO::ColumnCache::load(File f, JsonCursor document, JsonAllocator &allocator) {
+	for (auto &entry : columns) {
+		Column &column = entry.second;
+		JsonCursor field;
+		JsonValue value;
+		bool found = document.end() != document.begin() && document.find(entry.first.c_str(), &field) == JSON_OK &&
+			field.parse(&value, allocator) == JSON_OK;
+		JsonTag tag = found ? value.getTag() : JSON_NULL;
+
+		if (column.type == NUMBERS) {
+			uint64_t bit = 1ULL << (f % 64);
+			if (found && (tag == JSON_NUMBER || tag == JSON_INTEGER)) {
+				column.values[f] = tag == JSON_NUMBER ? value.toNumber() : (double)value.toInteger();
+				column.valid[f / 64] |= bit;
+			} else {
+				column.values[f] = 0;
+				column.valid[f / 64] &= ~bit;
+			}
+		} else if (!found) {
+			column.codes[f] = 0;
+		} else if (tag == JSON_STRING) {
+			column.codes[f] = intern(value.toString(), strlen(value.toString()));
+		} else if (tag == JSON_SLICE) {
+			column.codes[f] = intern(value.toSlice()->data, value.toSlice()->length);
+		} else {
+			JsonBuffer &text = threadBuffer();
+			text.clear();
+			column.codes[f] = jsonStringify(value, text) == JSON_OK ? intern(text.data(), text.size()) : 0;
+		}
+	}
+}
+
+uint32_t STORAGE::IO::ColumnCache::intern(const char *data, size_t length) {
+	std::lock_guard<std::mutex> lk(keyLock);
+	auto slot = codes.emplace(std::string(data, length), (uint32_t)keys.size() + 1);
+	if (slot.second) {
+		keys.push_back(slot.first->first);
+	}
+	return slot.first->second;
+}
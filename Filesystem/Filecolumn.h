@@ -0,0 +1,86 @@
+#ifndef _FILECOLUMN_H_
+#define _FILECOLUMN_H_
+#pragma once
+
+#include "RapidStashCommon.h"
+#include "FilesystemCommon.h"
+
+#include <gason.h>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Columns cache one field of every document, so that the field can be aggregated without reading the files.
+ * A column is an array indexed by file, kept alongside the change count each file had when it was loaded, and
+ * every aggregation first reloads the files that were written since.  Number columns are an array of doubles
+ * and a bitmap of the files that hold a number there.  Key columns, for grouping by, are dictionary codes.
+
+Number column:
+[Values]	-- One double per file
+[Valid]		-- One bit per file, 64 to a word
+*/
+
+namespace STORAGE {
+	class Filesystem; // Forward declare
+
+	namespace IO {
+		enum ColumnType {
+			NUMBERS,
+			KEYS
+		};
+
+		// Aggregates of a number column.  With no values, min is infinity and max is minus infinity.
+		struct Aggregate {
+			size_t count;
+			double sum;
+			double min;
+			double max;
+
+			Aggregate() : count(0), sum(0), min(std::numeric_limits<double>::infinity()), max(-std::numeric_limits<double>::infinity()) {}
+			double mean() const { return count ? sum / count : 0; }
+		};
+
+		/*
+		*  Column cache class.
+		*  The columns registered on a filesystem.  Registering a column reloads every file the next time the
+		*  columns are used.  Numbers are JSON numbers only (integers beyond 2^53 are rounded), and any value can
+		*  be a key: strings are used as they are, other values as their JSON text.  Aggregating a path that was
+		*  not registered, or registered as the other type, throws std::invalid_argument.
+		*/
+		class ColumnCache {
+		public:
+			static const File BLOCK = 4096;	// Files reloaded by one task.  A multiple of 64, so tasks do not share bitmap words.
+
+			ColumnCache(Filesystem *);
+			void add(const std::string &, ColumnType);
+			Aggregate aggregate(const std::string &);
+			std::map<std::string, Aggregate> aggregate(const std::string &, const std::string &);
+		private:
+			struct Column {
+				ColumnType type;
+				std::vector<double> values;		// NUMBERS: by file
+				std::vector<uint64_t> valid;	// NUMBERS: a bit per file, set where values holds a number
+				std::vector<uint32_t> codes;	// KEYS: by file, 0 where the field is missing, else an index into keys plus one
+			};
+			Column &find(const std::string &, ColumnType);
+			void refresh();
+			void load(File, JsonCursor, JsonAllocator &);
+			uint32_t intern(const char *, size_t);
+
+			Filesystem *fs;
+			std::mutex lock;		// One refresh or aggregation at a time
+			std::map<std::string, Column> columns;
+			std::vector<unsigned int> stamps;	// The change count of each file when it was last loaded
+
+			std::mutex keyLock;		// Guards the dictionary while files are reloaded
+			std::vector<std::string> keys;
+			std::unordered_map<std::string, uint32_t> codes;
+		};
+	}
+}
+#endif
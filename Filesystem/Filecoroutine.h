@@ -0,0 +1,155 @@
+#ifndef _FILECOROUTINE_H_
+#define _FILECOROUTINE_H_
+#pragma once
+
+#include "RapidStashCommon.h"
+#include "FilesystemCommon.h"
+#include "FileIOCommon.h"
+
+/*
+ * C++20 coroutine support.  Only compiled when the compiler implements coroutines, everything here
+ * is skipped otherwise and RAPIDSTASH_COROUTINES is left undefined.
+ */
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define RAPIDSTASH_COROUTINES 1
+#endif
+#endif
+
+#ifdef RAPIDSTASH_COROUTINES
+#include <coroutine>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace STORAGE {
+	class Filesystem; // Forward declare
+
+	namespace IO {
+		/*
+		*  Awaitable lock.
+		*  Suspends the awaiting coroutine until the lock is held, then resumes it on the filesystem's pool.
+		*  The coroutine must unlock the file when it is done with it.
+		*/
+		class LockAwaiter {
+		public:
+			LockAwaiter(Filesystem *fs, File file, LockType type) : fs(fs), file(file), type(type) {}
+			bool await_ready() { return false; }
+			void await_suspend(std::coroutine_handle<>);
+			void await_resume() {}
+		private:
+			Filesystem *fs;
+			File file;
+			LockType type;
+		};
+
+		/*
+		*  Awaitable hop onto the filesystem's pool.
+		*/
+		class ScheduleAwaiter {
+		public:
+			explicit ScheduleAwaiter(Filesystem *fs) : fs(fs) {}
+			bool await_ready() { return false; }
+			void await_suspend(std::coroutine_handle<>);
+			void await_resume() {}
+		private:
+			Filesystem *fs;
+		};
+
+		// The parts of a coroutine promise that do not depend on the result type
+		struct AsyncPromiseBase {
+			std::coroutine_handle<> continuation;	// The coroutine awaiting this one, if any
+			std::exception_ptr error;
+
+			// Used by Async::get to wait for a coroutine that nothing awaits
+			std::mutex mutex;
+			std::condition_variable cond;
+			bool finished = false;
+
+			struct FinalAwaiter {
+				bool await_ready() noexcept { return false; }
+				template<class Promise>
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> self) noexcept {
+					AsyncPromiseBase &promise = self.promise();
+					if (promise.continuation) {
+						return promise.continuation;
+					}
+					// Notify while holding the mutex, the waiter may destroy the frame as soon as it is released
+					std::lock_guard<std::mutex> lk(promise.mutex);
+					promise.finished = true;
+					promise.cond.notify_all();
+					return std::noop_coroutine();
+				}
+				void await_resume() noexcept {}
+			};
+
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			FinalAwaiter final_suspend() noexcept { return {}; }
+			void unhandled_exception() { error = std::current_exception(); }
+			void rethrow() {
+				if (error) {
+					std::rethrow_exception(error);
+				}
+			}
+		};
+
+		template<class T>
+		struct AsyncPromise : AsyncPromiseBase {
+			std::optional<T> value;
+			void return_value(T v) { value.emplace(std::move(v)); }
+			T result() { rethrow(); return std::move(*value); }
+		};
+
+		template<>
+		struct AsyncPromise<void> : AsyncPromiseBase {
+			void return_void() {}
+			void result() { rethrow(); }
+		};
+
+		/*
+		*  Coroutine result.
+		*  A lazily started coroutine producing a T.  It starts when it is awaited (and resumes the awaiting
+		*  coroutine when it finishes) or when get() is called, which blocks the calling thread until it is done.
+		*/
+		template<class T>
+		class Async {
+		public:
+			struct promise_type : AsyncPromise<T> {
+				Async get_return_object() { return Async(std::coroutine_handle<promise_type>::from_promise(*this)); }
+			};
+
+			Async(Async &&other) : handle(std::exchange(other.handle, nullptr)) {}
+			Async(const Async &) = delete;
+			~Async() {
+				if (handle) {
+					handle.destroy();
+				}
+			}
+
+			bool await_ready() { return false; }
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) {
+				handle.promise().continuation = caller;
+				return handle;
+			}
+			T await_resume() { return handle.promise().result(); }
+
+			T get() {
+				promise_type &promise = handle.promise();
+				handle.resume();
+				{
+					std::unique_lock<std::mutex> lk(promise.mutex);
+					promise.cond.wait(lk, [&] { return promise.finished; });
+				}
+				return promise.result();
+			}
+
+		private:
+			explicit Async(std::coroutine_handle<promise_type> h) : handle(h) {}
+			std::coroutine_handle<promise_type> handle;
+		};
+	}
+}
+#endif
+#endif
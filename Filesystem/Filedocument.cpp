@@ -0,0 +1,211 @@
+#include "Filedocument.h"
+#include "FilesystemCommon.h"
+#include "Filesystem.h"
+
+/*
+ *  Decoded document
+ */
+STORAGE::IO::Document::Document() : tape(false) {}
+
+STORAGE::IO::Document::Document(Document &&other) : buffer(std::move(other.buffer)), allocator(std::move(other.allocator)), value(other.value), tape(other.tape) {
+	other.value = JsonValue();
+}
+
+JsonValue STORAGE::IO::Document::root() {
+	return value;
+}
+
+bool STORAGE::IO::Document::isTape() {
+	return tape;
+}
+
+JsonNode *STORAGE::IO::Document::find(JsonValue object, const char *key) {
+	return jsonFind(object, key, allocator);
+}
+
+/*
+ *  Per-thread allocator pool
+ */
+static std::vector<std::unique_ptr<JsonAllocator>> &allocatorPool() {
+	static thread_local std::vector<std::unique_ptr<JsonAllocator>> pool;
+	return pool;
+}
+
+STORAGE::IO::PooledAllocator::PooledAllocator() {
+	auto &pool = allocatorPool();
+	if (pool.empty()) {
+		allocator = new JsonAllocator;
+	} else {
+		allocator = pool.back().release();
+		pool.pop_back();
+	}
+}
+
+STORAGE::IO::PooledAllocator::~PooledAllocator() {
+	// Values parsed with the allocator die with the lease, so its zones can be handed to the next borrower
+	auto &pool = allocatorPool();
+	if (pool.size() < MAX_POOLED) {
+		allocator->reset();
+		pool.emplace_back(allocator);
+	} else {
+		delete allocator;
+	}
+}
+
+JsonAllocator &STORAGE::IO::PooledAllocator::operator*() {
+	return *allocator;
+}
+
+JsonAllocator *STORAGE::IO::PooledAllocator::operator->() {
+	return allocator;
+}
+
+JsonBuffer &STORAGE::IO::threadBuffer() {
+	static thread_local JsonBuffer buffer;
+	return buffer;
+}
+
+/*
+ *  Document writer utility class
+ */
+STORAGE::IO::DocumentWriter::DocumentWriter(STORAGE::Filesystem *fs_, File file_) : Writer(fs_, file_) {}
+
+void STORAGE::IO::DocumentWriter::write(const char *json, FileSize size) {
+	// jsonParse works in place and needs a terminator, so parse a copy
+	std::vector<char> text(json, json + size);
+	text.push_back('\0');
+
+	char *endptr;
+	JsonValue value;
+	PooledAllocator allocator;
+	if (jsonParse(text.data(), &endptr, &value, *allocator) != JSON_OK) {
+		throw BadDocumentException();
+	}
+	write(value);
+}
+
+void STORAGE::IO::DocumentWriter::write(JsonValue value) {
+	std::vector<char> tape(jsonTapeSize(value));
+	jsonTapeEncode(value, tape.data());
+	Writer::write(tape.data(), tape.size());
+}
+
+void STORAGE::IO::DocumentWriter::patch(const char *json, FileSize size) {
+	std::vector<char> text(json, json + size);
+	text.push_back('\0');
+
+	char *endptr;
+	JsonValue value;
+	PooledAllocator allocator;
+	if (jsonParse(text.data(), &endptr, &value, *allocator) != JSON_OK) {
+		throw BadDocumentException();
+	}
+	patch(value);
+}
+
+void STORAGE::IO::DocumentWriter::patch(JsonValue value) {
+	apply([&](const char *data, FileSize size, JsonEdit **edits, JsonAllocator &allocator) {
+		return jsonMergePatch(data, size, value, edits, allocator);
+	});
+}
+
+void STORAGE::IO::DocumentWriter::set(const char *path, JsonValue value) {
+	apply([&](const char *data, FileSize size, JsonEdit **edits, JsonAllocator &allocator) {
+		return jsonSetPath(data, size, path, value, edits, allocator);
+	});
+}
+
+void STORAGE::IO::DocumentWriter::apply(std::function<int(const char *, FileSize, JsonEdit **, JsonAllocator &)> plan) {
+	PooledAllocator allocator;
+	JsonEdit *edits = nullptr, *rest = nullptr;
+	FilePosition restStart = 0;
+	std::vector<char> tail;
+	int status = JSON_OK;
+
+	// The edits (and the bytes they replace) are planned against the map, but nothing can be written until the
+	// view is over, so everything from the first edit that moves the rest of the file is gathered into a tail
+	current([&](const char *data, FileSize size) {
+		if ((status = plan(data, size, &edits, *allocator)) != JSON_OK) {
+			return;
+		}
+		for (rest = edits; rest && rest->size == rest->length && !fs->isMVCCEnabled(); rest = rest->next);
+		if (rest == nullptr) {
+			return;
+		}
+		restStart = rest->offset;
+		FilePosition at = restStart;
+		for (JsonEdit *edit = rest; edit; edit = edit->next) {
+			tail.insert(tail.end(), data + at, data + edit->offset);
+			tail.insert(tail.end(), edit->data, edit->data + edit->size);
+			at = edit->offset + edit->length;
+		}
+		tail.insert(tail.end(), data + at, data + size);
+	});
+	if (status != JSON_OK) {
+		throw BadDocumentException();
+	}
+
+	for (JsonEdit *edit = edits; edit != rest; edit = edit->next) {
+		overwrite(edit->offset, edit->data, edit->size);
+	}
+	if (rest != nullptr) {
+		seek(restStart, BEGIN);
+		Writer::write(tail.data(), tail.size());
+	}
+}
+
+/*
+ *  Document reader utility class
+ */
+STORAGE::IO::DocumentReader::DocumentReader(STORAGE::Filesystem *fs_, File file_) : Reader(fs_, file_) {}
+
+STORAGE::IO::Document STORAGE::IO::DocumentReader::read() {
+	Document document;
+	FileSize size = remaining();
+
+	// The map may be remapped by a concurrent write, so the document always decodes from its own copy.  The
+	// extra byte terminates the text of documents that were not written as a tape.
+	document.buffer.resize(size + 1);
+	Reader::read(document.buffer.data(), size);
+	document.buffer[size] = '\0';
+
+	int status;
+	if (jsonIsTape(document.buffer.data(), size)) {
+		document.tape = true;
+		status = jsonTapeDecode(document.buffer.data(), size, &document.value, document.allocator);
+	} else {
+		char *endptr;
+		status = jsonParse(document.buffer.data(), &endptr, &document.value, document.allocator);
+	}
+	if (status != JSON_OK) {
+		throw BadDocumentException();
+	}
+	return document;
+}
+
+void STORAGE::IO::DocumentReader::view(std::function<void(JsonValue)> fn) {
+	PooledAllocator allocator;
+	int status = JSON_OK;
+	Reader::view([&](const char *data, FileSize size) {
+		JsonValue value;
+		if (jsonIsTape(data, size)) {
+			// Decoding only reads the tape, the strings it points at are never written through
+			status = jsonTapeDecode(const_cast<char *>(data), size, &value, *allocator);
+		} else {
+			const char *endptr;
+			status = jsonParseView(data, size, &endptr, &value, *allocator);
+		}
+		if (status == JSON_OK) {
+			fn(value);
+		}
+	});
+	if (status != JSON_OK) {
+		throw BadDocumentException();
+	}
+}
+
+void STORAGE::IO::DocumentReader::cursor(std::function<void(JsonCursor)> fn) {
+	Reader::view([&](const char *data, FileSize size) {
+		fn(JsonCursor(data, size));
+	});
+}
@@ -0,0 +1,133 @@
+#ifndef _FILEDOCUMENT_H_
+#define _FILEDOCUMENT_H_
+#pragma once
+
+#include "RapidStashCommon.h"
+#include "FilesystemCommon.h"
+#include "FileIOCommon.h"
+#include "Filewriter.h"
+#include "Filereader.h"
+
+#include <gason.h>
+#include <functional>
+#include <memory>
+#include <new>
+#include <vector>
+
+/*
+ * Documents are JSON values stored as a gason binary tape instead of as text.  The JSON is validated and
+ * tokenized once when it is written, so reading a document back only has to walk the tape and point the
+ * resulting JsonValue into it.  Files holding plain JSON text (written before documents existed) are still
+ * readable and are parsed as usual.
+
+Document structure:
+[Magic]
+[Tape]
+	...
+	{ Value
+		[Tag]
+		[Payload] -- Number, length prefixed string, or count and byte length prefixed members
+	}
+	...
+*/
+
+namespace STORAGE {
+	class Filesystem; // Forward declare
+
+	namespace IO {
+
+		/*
+		*  Document class.
+		*  A decoded document.  The root value points into memory owned by the document, so it stays valid
+		*  exactly as long as the document does, and is unaffected by later writes to the file.  find() looks
+		*  up a member of one of its objects, indexing wide objects in the document's allocator.
+		*/
+		class Document {
+			friend class DocumentReader;
+		public:
+			Document();
+			Document(Document &&);
+			Document(const Document &) = delete;
+			JsonValue root();
+			bool isTape();
+			JsonNode *find(JsonValue, const char *);
+		private:
+			std::vector<char> buffer;
+			JsonAllocator allocator;
+			JsonValue value;
+			bool tape;
+		};
+
+		/*
+		*  Pooled allocator class.
+		*  Borrows a JsonAllocator from a per-thread pool for as long as it lives.  Allocators are reset rather
+		*  than freed when they are returned, so a thread that keeps parsing documents keeps reusing the same
+		*  zones instead of going back to malloc for every document.
+		*/
+		class PooledAllocator {
+		public:
+			static const size_t MAX_POOLED = 8;	// Allocators kept per thread
+
+			PooledAllocator();
+			PooledAllocator(const PooledAllocator &) = delete;
+			~PooledAllocator();
+			JsonAllocator &operator*();
+			JsonAllocator *operator->();
+		private:
+			JsonAllocator *allocator;
+		};
+
+		/*
+		*  Document writer class.
+		*  Parses JSON text (or takes an already parsed value) and writes it as a tape.  patch() applies an RFC 7386
+		*  merge patch and set() replaces (or adds) the value at a path, on tapes and text alike.  Both only rewrite
+		*  the bytes that change: edits that keep their size are written in place, and the file is only rewritten
+		*  from the first edit that does not (from the first edit at all under MVCC, so the old version survives).
+		*  The user must perform all locking/unlocking if necessary.
+		*/
+		class DocumentWriter : public Writer {
+		public:
+			DocumentWriter(Filesystem *, File);
+			void write(const char *, FileSize);
+			void write(JsonValue);
+			void patch(const char *, FileSize);
+			void patch(JsonValue);
+			void set(const char *, JsonValue);
+		private:
+			void apply(std::function<int(const char *, FileSize, JsonEdit **, JsonAllocator &)>);
+		};
+
+		/*
+		*  Writes a value as JSON text through any of the writers, with a single write.  The text is formatted into
+		*  a buffer kept per thread, so once it has grown to fit the documents a thread writes, formatting them
+		*  does not allocate.  The writer's own locking rules apply.
+		*/
+		JsonBuffer &threadBuffer();
+
+		template <typename W>
+		void writeJson(W &writer, JsonValue value) {
+			JsonBuffer &buffer = threadBuffer();
+			buffer.clear();
+			if (jsonStringify(value, buffer) != JSON_OK) {
+				throw std::bad_alloc();
+			}
+			writer.write(buffer.data(), buffer.size());
+		}
+
+		/*
+		*  Document reader class.
+		*  read() copies the file out of the memory map once and decodes it in place.  view() decodes straight
+		*  out of the map instead, so the value it hands over (strings included) is only valid inside the
+		*  callback.  cursor() hands over the undecoded file, for pulling a few fields out of a large document.
+		*  The user must perform all locking/unlocking if necessary.
+		*/
+		class DocumentReader : public Reader {
+		public:
+			DocumentReader(Filesystem *, File);
+			Document read();
+			void view(std::function<void(JsonValue)>);
+			void cursor(std::function<void(JsonCursor)>);
+		};
+	}
+}
+#endif
@@ -0,0 +1,221 @@
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <stdexcept>
+
+#include "Fileimport.h"
+#include "Filedocument.h"
+#include "FilesystemCommon.h"
+#include "Filesystem.h"
+
+// A chunk of input and the batch it becomes.  Documents are laid out in data exactly as they will be written,
+// each behind room for its header, which is filled in when the batch is committed.
+struct STORAGE::IO::Importer::Batch {
+	std::vector<char> input;
+	std::vector<char> data;
+	std::vector<BatchEntry> entries;	// Unnamed until the batch is committed, when documents are named by line
+	std::vector<size_t> entryLines;		// The line of each entry within the chunk, counting from 0
+	std::vector<size_t> rejected;		// Lines within the chunk
+	size_t lines;
+};
+
+// Whether x is a whole number that fits a long long.  Casting is undefined for NaN, infinities and anything out of
+// range, so they are ruled out first.
+static bool isWholeNumber(double x) {
+	return std::isfinite(x) && x > -9.2e18 && x < 9.2e18 && x == std::trunc(x);
+}
+
+STORAGE::IO::Importer::Importer(STORAGE::Filesystem *fs_, ImportOptions options_) : fs(fs_), options(options_), line(0) {
+	// Batches of short lines are many times the size of their input once every line has a header
+	if (options.chunkSize == 0 || options.chunkSize > MaxFileSize / 64) {
+		logEvent(WARNING, "Invalid import chunk size " + toString(options.chunkSize) + ", using the default");
+		options.chunkSize = ImportOptions::DEFAULT_CHUNK_SIZE;
+	}
+
+	// Leave room for the key, or for the longest line number
+	size_t room = options.keyPath.empty() ? std::numeric_limits<size_t>::digits10 + 1 : 1;
+	if (options.prefix.size() + room >= FileHeader::MAXNAMELEN) {
+		throw std::invalid_argument("import prefix too long for a file name");
+	}
+}
+
+STORAGE::IO::ImportResult STORAGE::IO::Importer::import(const std::string &path) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		throw FileNotFoundException();
+	}
+	return import(in);
+}
+
+// Read chunks on the calling thread while the pool parses the ones before them, and commit them in order so that
+// later lines win and line numbers are known.  A few chunks per worker are kept in flight, which bounds memory.
+STORAGE::IO::ImportResult STORAGE::IO::Importer::import(std::istream &in) {
+	typedef std::pair<std::shared_ptr<Batch>, std::future<void>> Pending;
+
+	ImportResult result;
+	THREADING::ThreadPool *workers = fs->getPool();
+	size_t window = workers->workerCount() * 2 + 1;
+	std::deque<Pending> pending;
+	std::vector<char> carry;
+	line = 0;
+
+	try {
+		while (in) {
+			std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+			std::vector<char> &input = batch->input;
+			input.swap(carry);
+
+			// Read at least a chunk, and on until the chunk ends in a newline, so no line is split between batches
+			size_t scanned = 0;
+			const char *newline = nullptr;
+			while (in) {
+				size_t have = input.size();
+				input.resize(have + options.chunkSize);
+				in.read(input.data() + have, options.chunkSize);
+				input.resize(have + (size_t)in.gcount());
+				result.bytes += (FileSize)in.gcount();
+
+				for (const char *p = input.data() + input.size(); p > input.data() + scanned; --p) {
+					if (p[-1] == '\n') {
+						newline = p - 1;
+						break;
+					}
+				}
+				if (newline != nullptr) {
+					break;
+				}
+				scanned = input.size();
+			}
+			if (newline != nullptr && in) {
+				carry.assign(newline + 1, (const char *)input.data() + input.size());
+				input.resize(newline + 1 - input.data());
+			}
+			if (input.empty()) {
+				break;
+			}
+
+			Batch *b = batch.get();
+			pending.push_back(Pending(batch, workers->enqueue([this, b] { parse(*b); })));
+			while (pending.size() > window) {
+				pending.front().second.get();
+				commit(*pending.front().first, result);
+				pending.pop_front();
+			}
+		}
+		while (!pending.empty()) {
+			pending.front().second.get();
+			commit(*pending.front().first, result);
+			pending.pop_front();
+		}
+	} catch (...) {
+		// Tasks still hold pointers into their batches
+		for (Pending &p : pending) {
+			p.second.wait();
+		}
+		fs->writeFileDirectory(fs->dir);
+		throw;
+	}
+
+	// Headers went out with every batch, so the directory is all that is left to make the import durable
+	fs->writeFileDirectory(fs->dir);
+	return result;
+}
+
+// Validate each line and encode it, and pull out its name if documents are named by a key
+void STORAGE::IO::Importer::parse(Batch &batch) {
+	PooledAllocator allocator;
+	const char *p = batch.input.data(), *end = p + batch.input.size();
+	batch.data.reserve(batch.input.size() + batch.input.size() / 4);
+	batch.lines = 0;
+
+	for (; p < end; ++batch.lines) {
+		const char *eol = (const char *)memchr(p, '\n', end - p);
+		if (eol == nullptr) {
+			eol = end;
+		}
+		const char *s = p, *e = eol;
+		p = eol + 1;
+		while (s < e && isspace((unsigned char)*s)) {
+			++s;
+		}
+		while (e > s && isspace((unsigned char)e[-1])) {
+			--e;
+		}
+		if (s == e) {
+			continue;
+		}
+
+		JsonValue value;
+		const char *endptr;
+		bool valid = jsonParseView(s, e - s, &endptr, &value, *allocator) == JSON_OK && endptr == e;
+		FilePosition at = batch.data.size();
+		FileSize size = 0;
+		if (valid) {
+			size = options.tape ? jsonTapeSize(value) : e - s;
+			batch.data.resize(at + FileHeader::SIZE + size);
+			char *document = batch.data.data() + at + FileHeader::SIZE;
+			if (options.tape) {
+				jsonTapeEncode(value, document);
+			} else {
+				memcpy(document, s, size);
+			}
+		}
+
+		std::string name;
+		if (valid && !options.keyPath.empty()) {
+			JsonCursor key;
+			JsonValue k;
+			valid = JsonCursor(batch.data.data() + at + FileHeader::SIZE, size).find(options.keyPath.c_str(), &key) == JSON_OK &&
+				key.parse(&k, *allocator) == JSON_OK;
+			if (valid && k.getTag() == JSON_STRING) {
+				name = options.prefix + k.toString();
+			} else if (valid && k.getTag() == JSON_SLICE) {
+				name = options.prefix + std::string(k.toSlice()->data, k.toSlice()->length);
+			} else if (valid && k.getTag() == JSON_INTEGER) {
+				name = options.prefix + toString(k.toInteger());
+			} else if (valid && k.getTag() == JSON_NUMBER && isWholeNumber(k.toNumber())) {
+				name = options.prefix + toString((long long)k.toNumber());
+			} else {
+				valid = false;
+			}
+			valid = valid && !name.empty() && name.size() < FileHeader::MAXNAMELEN;
+		}
+		allocator->reset();
+
+		if (!valid) {
+			batch.data.resize(at);
+			batch.rejected.push_back(batch.lines);
+			continue;
+		}
+		batch.entries.push_back(BatchEntry{ at, size, name });
+		batch.entryLines.push_back(batch.lines);
+	}
+}
+
+// Name the documents if they are named by line, and write the batch
+void STORAGE::IO::Importer::commit(Batch &batch, ImportResult &result) {
+	for (size_t rejected : batch.rejected) {
+		if (result.rejectedLines.size() < ImportResult::MAX_REPORTED) {
+			result.rejectedLines.push_back(line + rejected + 1);
+		}
+	}
+	result.rejected += batch.rejected.size();
+
+	if (options.keyPath.empty()) {
+		for (size_t i = 0; i < batch.entries.size(); ++i) {
+			batch.entries[i].name = options.prefix + toString(line + batch.entryLines[i] + 1);
+		}
+	}
+	line += batch.lines;
+
+	fs->writeBatch(batch.data, batch.entries);
+	result.documents += batch.entries.size();
+
+	// The batch is done with, so release its memory now rather than when the window moves on
+	std::vector<char>().swap(batch.data);
+	std::vector<char>().swap(batch.input);
+}
@@ -0,0 +1,79 @@
+#ifndef _FILEIMPORT_H_
+#define _FILEIMPORT_H_
+#pragma once
+
+#include "RapidStashCommon.h"
+#include "FilesystemCommon.h"
+#include "FileIOCommon.h"
+
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Bulk loading of newline delimited JSON, one document per line.  The input is cut into chunks of whole lines,
+ * the chunks are parsed and encoded on the filesystem's thread pool, and each chunk is written as a single batch:
+ * one contiguous run of headers and documents, placed with one reservation and one write.  Files are not locked
+ * one at a time and the directory is only written once, at the end, so nothing else may use the filesystem while
+ * an import is running.
+
+Batch structure:
+[Files]
+	...
+	{ File
+		[File header]
+		[Document] -- A tape, or the text of the line
+	}
+	...
+*/
+
+namespace STORAGE {
+	class Filesystem; // Forward declare
+
+	namespace IO {
+		struct ImportOptions {
+			static const FileSize DEFAULT_CHUNK_SIZE = 1 << 23;	// 8MB of input per batch
+
+			std::string keyPath;	// Path (as for JsonCursor::find) to the member naming each document, or empty to name them by line number
+			std::string prefix;		// Prepended to every name
+			FileSize chunkSize;		// Input parsed by one task and written in one batch
+			bool tape;				// Store tapes, as a DocumentWriter would, rather than the text of each line
+
+			ImportOptions() : chunkSize(DEFAULT_CHUNK_SIZE), tape(true) {}
+		};
+
+		struct ImportResult {
+			static const size_t MAX_REPORTED = 100;
+
+			size_t documents;					// Documents written
+			size_t rejected;					// Lines that were not a single JSON value or had no usable name
+			FileSize bytes;						// Input read
+			std::vector<size_t> rejectedLines;	// The first MAX_REPORTED rejected lines, counting from 1
+
+			ImportResult() : documents(0), rejected(0), bytes(0) {}
+		};
+
+		/*
+		*  Importer class.
+		*  Imports a stream or a file of newline delimited JSON.  Documents whose name is already in use replace
+		*  the existing file, as a write would, and a name given twice takes the later line.  Blank lines are
+		*  skipped.  Keys must be strings or integers, and names must be shorter than a file header allows.
+		*/
+		class Importer {
+		public:
+			Importer(Filesystem *, ImportOptions = ImportOptions());
+			ImportResult import(std::istream &);
+			ImportResult import(const std::string &);
+		private:
+			struct Batch;
+			void parse(Batch &);
+			void commit(Batch &, ImportResult &);
+
+			Filesystem *fs;
+			ImportOptions options;
+			size_t line;	// Lines committed so far
+		};
+	}
+}
+#endif
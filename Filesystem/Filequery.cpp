@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <cstring>
+
+#include "Filequery.h"
+
+STORAGE::IO::Query &STORAGE::IO::Query::where(const std::string &path, QueryOp op) {
+	return add(path, op, JSON_NULL, 0, 0, std::string());
+}
+
+STORAGE::IO::Query &STORAGE::IO::Query::where(const std::string &path, QueryOp op, double value) {
+	return add(path, op, JSON_NUMBER, value, 0, std::string());
+}
+
+STORAGE::IO::Query &STORAGE::IO::Query::where(const std::string &path, QueryOp op, int value) {
+	return where(path, op, (int64_t)value);
+}
+
+STORAGE::IO::Query &STORAGE::IO::Query::where(const std::string &path, QueryOp op, int64_t value) {
+	return add(path, op, JSON_INTEGER, (double)value, value, std::string());
+}
+
+STORAGE::IO::Query &STORAGE::IO::Query::where(const std::string &path, QueryOp op, bool value) {
+	return add(path, op, value ? JSON_TRUE : JSON_FALSE, 0, 0, std::string());
+}
+
+STORAGE::IO::Query &STORAGE::IO::Query::where(const std::string &path, QueryOp op, const char *value) {
+	return add(path, op, JSON_STRING, 0, 0, std::string(value));
+}
+
+STORAGE::IO::Query &STORAGE::IO::Query::where(const std::string &path, QueryOp op, const std::string &value) {
+	return add(path, op, JSON_STRING, 0, 0, value);
+}
+
+STORAGE::IO::Query &STORAGE::IO::Query::select(const std::string &path) {
+	projection.push_back(path);
+	return *this;
+}
+
+size_t STORAGE::IO::Query::fields() const {
+	return projection.size();
+}
+
+STORAGE::IO::Query &STORAGE::IO::Query::add(const std::string &path, QueryOp op, JsonTag tag, double number, int64_t integer, const std::string &string) {
+	conditions.push_back(Condition{ path, op, tag, number, integer, string });
+	return *this;
+}
+
+// Conditions are checked in the order they were given, and checking stops at the first that fails, so the
+// selected fields are only found in documents that match
+bool STORAGE::IO::Query::match(JsonCursor document, std::vector<JsonValue> &values, JsonAllocator &allocator) const {
+	for (const Condition &condition : conditions) {
+		JsonCursor field;
+		JsonValue value;
+		if (document.find(condition.path.c_str(), &field) != JSON_OK) {
+			return false;
+		}
+		if (condition.op == EXISTS) {
+			continue;
+		}
+		if (field.parse(&value, allocator) != JSON_OK || !holds(condition, value)) {
+			return false;
+		}
+	}
+
+	values.assign(projection.size(), JsonValue());
+	for (size_t i = 0; i < projection.size(); ++i) {
+		JsonCursor field;
+		if (document.find(projection[i].c_str(), &field) != JSON_OK || field.parse(&values[i], allocator) != JSON_OK) {
+			values[i] = JsonValue();
+		}
+	}
+	return true;
+}
+
+bool STORAGE::IO::Query::holds(const Condition &condition, JsonValue value) {
+	JsonTag tag = value.getTag();
+	int order;
+	bool comparable;
+
+	if (condition.tag == JSON_INTEGER && tag == JSON_INTEGER) {
+		// Doubles cannot tell integers apart beyond 2^53
+		comparable = true;
+		order = value.toInteger() < condition.integer ? -1 : value.toInteger() > condition.integer ? 1 : 0;
+	} else if (condition.tag == JSON_NUMBER || condition.tag == JSON_INTEGER) {
+		double number = tag == JSON_INTEGER ? (double)value.toInteger() : tag == JSON_NUMBER ? value.toNumber() : 0;
+		comparable = tag == JSON_NUMBER || tag == JSON_INTEGER;
+		order = number < condition.number ? -1 : number > condition.number ? 1 : 0;
+	} else if (condition.tag == JSON_STRING) {
+		// Text documents hold slices, tapes hold terminated strings
+		const char *data = tag == JSON_SLICE ? value.toSlice()->data : tag == JSON_STRING ? value.toString() : "";
+		size_t length = tag == JSON_SLICE ? value.toSlice()->length : strlen(data);
+		comparable = tag == JSON_STRING || tag == JSON_SLICE;
+		order = memcmp(data, condition.string.data(), std::min(length, condition.string.size()));
+		if (order == 0) {
+			order = length < condition.string.size() ? -1 : length > condition.string.size() ? 1 : 0;
+		}
+	} else if (condition.tag == JSON_TRUE || condition.tag == JSON_FALSE) {
+		comparable = tag == JSON_TRUE || tag == JSON_FALSE;
+		order = tag == condition.tag ? 0 : tag == JSON_FALSE ? -1 : 1;
+	} else {
+		comparable = tag == JSON_NULL;
+		order = 0;
+	}
+
+	if (!comparable) {
+		return condition.op == NOTEQUAL;
+	}
+	switch (condition.op) {
+	case EQUAL: return order == 0;
+	case NOTEQUAL: return order != 0;
+	case LESS: return order < 0;
+	case LESSEQUAL: return order <= 0;
+	case GREATER: return order > 0;
+	case GREATEREQUAL: return order >= 0;
+	default: return true;
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef _FILEQUERY_H_
+#define _FILEQUERY_H_
+#pragma once
+
+#include "RapidStashCommon.h"
+#include "FilesystemCommon.h"
+
+#include <gason.h>
+#include <string>
+#include <vector>
+
+/*
+ * Queries select the documents whose fields pass a set of conditions and pull a few fields out of each of them.
+ * Fields are named by paths, as for JsonCursor::find, so a document is only walked as far as the fields a query
+ * names: everything else is skipped without being parsed, and only the values that are compared or selected are
+ * ever built.  Filesystem::query runs a query over every file on the filesystem's thread pool.
+ */
+
+namespace STORAGE {
+	namespace IO {
+		enum QueryOp {
+			EQUAL,
+			NOTEQUAL,
+			LESS,
+			LESSEQUAL,
+			GREATER,
+			GREATEREQUAL,
+			EXISTS
+		};
+
+		/*
+		*  Query class.
+		*  A document matches when every condition holds.  A condition on a field that is missing never holds,
+		*  and a field that holds another kind of value than the one it is compared with is only NOTEQUAL to
+		*  it.  Strings compare byte by byte, false is less than true, and a condition given no value compares
+		*  with null (EXISTS only asks for the field to be there).  Integers compare exactly with integers, which
+		*  documents hold beyond 2^53, and as doubles with other numbers.  Selected fields that are missing come
+		*  back as null.
+		*/
+		class Query {
+		public:
+			Query &where(const std::string &, QueryOp = EXISTS);
+			Query &where(const std::string &, QueryOp, double);
+			Query &where(const std::string &, QueryOp, int);
+			Query &where(const std::string &, QueryOp, int64_t);
+			Query &where(const std::string &, QueryOp, bool);
+			Query &where(const std::string &, QueryOp, const char *);
+			Query &where(const std::string &, QueryOp, const std::string &);
+			Query &select(const std::string &);
+			size_t fields() const;
+
+			// Check a document (text or tape) and, if it matches, build the selected fields in the allocator
+			bool match(JsonCursor, std::vector<JsonValue> &, JsonAllocator &) const;
+		private:
+			struct Condition {
+				std::string path;
+				QueryOp op;
+				JsonTag tag;		// Of the value compared with: JSON_NUMBER, JSON_INTEGER, JSON_STRING, JSON_TRUE, JSON_FALSE or JSON_NULL
+				double number;		// Also set for integers
+				int64_t integer;
+				std::string string;
+			};
+			Query &add(const std::string &, QueryOp, JsonTag, double, int64_t, const std::string &);
+			static bool holds(const Condition &, JsonValue);
+
+			std::vector<Condition> conditions;
+			std::vector<std::string> projection;
+		};
+	}
+}
+#endif
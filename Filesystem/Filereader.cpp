@@ -85,6 +85,69 @@ char *STORAGE::IO::Reader::readRaw(FileSize amt) {
 		start = Clock::now();
 	}
 
+	size_t offset = locate(amt);
+	char *data = fs->file.raw_read(offset, amt);
+
+	bytesRead += amt;
+	numReads++;
+	position += amt;
+
+	if (timingEnabled) {
+		TimeSpan time_span = std::chrono::duration_cast<TimeSpan>(Clock::now() - start);
+		readTime.store(readTime.load() + time_span.count());
+	}
+	return data;
+}
+
+// Read into a caller provided buffer.  Avoids an allocation per read, which matters when streaming.
+void STORAGE::IO::Reader::read(char *data, FileSize amt) {
+	TimePoint start;
+	if (timingEnabled) {
+		start = Clock::now();
+	}
+
+	size_t offset = locate(amt);
+	fs->file.raw_read_into(data, offset, amt);
+
+	bytesRead += amt;
+	numReads++;
+	position += amt;
+
+	if (timingEnabled) {
+		TimeSpan time_span = std::chrono::duration_cast<TimeSpan>(Clock::now() - start);
+		readTime.store(readTime.load() + time_span.count());
+	}
+}
+
+// Hand the rest of the file to a callback without copying it.  The pointer must not be kept after it returns.
+void STORAGE::IO::Reader::view(std::function<void(const char *, FileSize)> fn) {
+	TimePoint start;
+	if (timingEnabled) {
+		start = Clock::now();
+	}
+
+	FileSize amt = remaining();
+	size_t offset = locate(amt);
+	fs->file.raw_view(offset, amt, [&](const char *data) { fn(data, amt); });
+
+	bytesRead += amt;
+	numReads++;
+	position += amt;
+
+	if (timingEnabled) {
+		TimeSpan time_span = std::chrono::duration_cast<TimeSpan>(Clock::now() - start);
+		readTime.store(readTime.load() + time_span.count());
+	}
+}
+
+// The number of bytes between the cursor and the end of the version of the file that would be read
+FileSize STORAGE::IO::Reader::remaining() {
+	locate(0);
+	return lastHeader.size - position;
+}
+
+// Find the raw location of the next amt bytes of the file
+FilePosition STORAGE::IO::Reader::locate(FileSize amt) {
 	STORAGE::FileHeader &header = fs->dir->headers[file];
 	FilePosition loc;
 	FileSize size;
@@ -105,16 +168,5 @@ char *STORAGE::IO::Reader::readRaw(FileSize amt) {
 		throw ReadOutOfBoundsException();
 	}
 
-	size_t offset = loc + STORAGE::FileHeader::SIZE + position;
-	char *data = fs->file.raw_read(offset, amt);
-
-	bytesRead += amt;
-	numReads++;
-	position += amt;
-
-	if (timingEnabled) {
-		TimeSpan time_span = std::chrono::duration_cast<TimeSpan>(Clock::now() - start);
-		readTime.store(readTime.load() + time_span.count());
-	}
-	return data;
+	return loc + STORAGE::FileHeader::SIZE + position;
 }
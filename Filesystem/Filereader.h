@@ -6,6 +6,8 @@
 #include "FilesystemCommon.h"
 #include "FileIOCommon.h"
 
+#include <functional>
+
 namespace STORAGE {
 	class Filesystem; // Forward declare
 
@@ -24,6 +26,11 @@ namespace STORAGE {
 			std::string readString();
 			char *readRaw(FileSize);
 			char *readRaw();
+			void read(char *, FileSize);
+			void view(std::function<void(const char *, FileSize)>);
+			FileSize remaining();
+		protected:
+			FilePosition locate(FileSize);
 		};
 
 		class SafeReader : public Reader {
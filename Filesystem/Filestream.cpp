@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "Filestream.h"
+#include "FilesystemCommon.h"
+#include "Filesystem.h"
+
+// Chunk files are named after a hash of the stream name so that long names still fit in a file header
+std::string STORAGE::IO::chunkName(const std::string &name, FileSize index) {
+	// 64 bit FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (char c : name) {
+		hash ^= (unsigned char)c;
+		hash *= 1099511628211ULL;
+	}
+	std::ostringstream os;
+	os << "$" << std::hex << std::setw(16) << std::setfill('0') << hash << "." << std::dec << index;
+	return os.str();
+}
+
+// Read the manifest of a stream.  Returns false if the file does not exist or is not a manifest.
+bool STORAGE::IO::readManifest(STORAGE::Filesystem *fs, const std::string &name, StreamManifest &manifest) {
+	File f = fs->find(name);
+	if (f == NOFILE) {
+		return false;
+	}
+
+	Reader reader = fs->getReader(f);
+	char buffer[StreamManifest::SIZE];
+	bool valid = false;
+	fs->lock(f, SHARED);
+	{
+		if (fs->getHeader(f).size == StreamManifest::SIZE) {
+			reader.read(buffer, StreamManifest::SIZE);
+			valid = true;
+		}
+	}
+	fs->unlock(f, SHARED);
+
+	if (!valid || memcmp(buffer, STREAMMAGIC, sizeof(STREAMMAGIC)) != 0) {
+		return false;
+	}
+
+	size_t offset = sizeof(STREAMMAGIC);
+	memcpy(&manifest.size, buffer + offset, sizeof(FileSize));
+	offset += sizeof(FileSize);
+	memcpy(&manifest.chunkSize, buffer + offset, sizeof(FileSize));
+	offset += sizeof(FileSize);
+	memcpy(&manifest.numChunks, buffer + offset, sizeof(FileSize));
+	return true;
+}
+
+/*
+ *  Stream writer utility class
+ */
+STORAGE::IO::StreamWriter::StreamWriter(STORAGE::Filesystem *fs_, std::string name_, FileSize chunkSize) : fs(fs_), name(name_), closed(false) {
+	// A chunk is a regular file, so it is subject to the same size limit
+	if (chunkSize == 0 || chunkSize > MaxFileSize) {
+		logEvent(WARNING, "Invalid chunk size " + toString(chunkSize) + ", using the default");
+		chunkSize = DEFAULT_CHUNK_SIZE;
+	}
+	manifest.size = 0;
+	manifest.chunkSize = chunkSize;
+	manifest.numChunks = 0;
+	buffer.reserve(chunkSize);
+}
+
+STORAGE::IO::StreamWriter::StreamWriter(StreamWriter &&other) : fs(other.fs), name(std::move(other.name)), buffer(std::move(other.buffer)), manifest(other.manifest), closed(other.closed) {
+	other.closed = true;
+}
+
+STORAGE::IO::StreamWriter::~StreamWriter() {
+	close();
+}
+
+void STORAGE::IO::StreamWriter::write(const char *data, FileSize size) {
+	if (closed) {
+		logEvent(ERROR, "Attempted to write to a closed stream");
+		return;
+	}
+
+	while (size > 0) {
+		FileSize amt = std::min(size, manifest.chunkSize - buffer.size());
+		buffer.insert(buffer.end(), data, data + amt);
+		data += amt;
+		size -= amt;
+		manifest.size += amt;
+
+		if (buffer.size() == manifest.chunkSize) {
+			writeChunk();
+		}
+	}
+}
+
+// Write the last partial chunk and the manifest.  Chunks left over from a previous, larger object are removed.
+void STORAGE::IO::StreamWriter::close() {
+	if (closed) {
+		return;
+	}
+	closed = true;
+
+	if (!buffer.empty()) {
+		writeChunk();
+	}
+	std::vector<char>().swap(buffer);
+
+	StreamManifest old;
+	if (readManifest(fs, name, old)) {
+		for (FileSize i = manifest.numChunks; i < old.numChunks; ++i) {
+			std::string stale = chunkName(name, i);
+			if (fs->exists(stale)) {
+				fs->unlink(fs->select(stale));
+			}
+		}
+	}
+
+	char data[StreamManifest::SIZE];
+	size_t offset = 0;
+	memcpy(data + offset, STREAMMAGIC, sizeof(STREAMMAGIC));
+	offset += sizeof(STREAMMAGIC);
+	memcpy(data + offset, reinterpret_cast<char*>(&manifest.size), sizeof(FileSize));
+	offset += sizeof(FileSize);
+	memcpy(data + offset, reinterpret_cast<char*>(&manifest.chunkSize), sizeof(FileSize));
+	offset += sizeof(FileSize);
+	memcpy(data + offset, reinterpret_cast<char*>(&manifest.numChunks), sizeof(FileSize));
+
+	File f = fs->select(name);
+	SafeWriter writer = fs->getSafeWriter(f);
+	writer.write(data, StreamManifest::SIZE);
+}
+
+FileSize STORAGE::IO::StreamWriter::tell() {
+	return manifest.size;
+}
+
+void STORAGE::IO::StreamWriter::writeChunk() {
+	File f = fs->select(chunkName(name, manifest.numChunks));
+	SafeWriter writer = fs->getSafeWriter(f);
+	writer.write(buffer.data(), buffer.size());
+	manifest.numChunks++;
+	buffer.clear();
+}
+
+/*
+ *  Stream reader utility class
+ */
+STORAGE::IO::StreamReader::StreamReader(STORAGE::Filesystem *fs_, std::string name_) : fs(fs_), name(name_), position(0) {
+	if (!readManifest(fs, name, manifest)) {
+		throw BadStreamException();
+	}
+}
+
+// Read up to amt bytes into the buffer.  Returns the number of bytes read, which is 0 at the end of the stream.
+// Throws a FileNotFoundException if a chunk is missing, without creating it.
+FileSize STORAGE::IO::StreamReader::read(char *data, FileSize amt) {
+	FileSize total = 0;
+	while (amt > 0 && position < manifest.size) {
+		FileSize index = position / manifest.chunkSize;
+		FilePosition offset = position % manifest.chunkSize;
+		FileSize chunkLength = std::min(manifest.chunkSize, manifest.size - index * manifest.chunkSize);
+		FileSize n = std::min(amt, chunkLength - offset);
+
+		File f = fs->find(chunkName(name, index));
+		if (f == NOFILE) {
+			throw FileNotFoundException();
+		}
+		Reader reader = fs->getReader(f);
+		fs->lock(f, SHARED);
+		try {
+			reader.seek(offset, BEGIN);
+			reader.read(data, n);
+		} catch (...) {
+			fs->unlock(f, SHARED);
+			throw;
+		}
+		fs->unlock(f, SHARED);
+
+		data += n;
+		amt -= n;
+		total += n;
+		position += n;
+	}
+	return total;
+}
+
+void STORAGE::IO::StreamReader::seek(FilePosition pos) {
+	if (pos > manifest.size) {
+		throw SeekOutOfBoundsException();
+	}
+	position = pos;
+}
+
+FilePosition STORAGE::IO::StreamReader::tell() {
+	return position;
+}
+
+FileSize STORAGE::IO::StreamReader::size() {
+	return manifest.size;
+}
@@ -0,0 +1,94 @@
+#ifndef _FILESTREAM_H_
+#define _FILESTREAM_H_
+#pragma once
+
+#include "RapidStashCommon.h"
+#include "FilesystemCommon.h"
+#include "FileIOCommon.h"
+
+#include <string>
+#include <vector>
+
+/*
+ * Large objects are stored as a small manifest file under the user supplied name and a sequence of
+ * fixed size chunk files.  Only one chunk is ever held in memory, so objects larger than a single file
+ * (and larger than available memory) can be moved in and out of the filesystem.
+
+Stream structure:
+[Manifest] -- Stored in the file with the user supplied name
+	[Magic]
+	[Total Size]
+	[Chunk Size]
+	[Num Chunks]
+[Chunks]
+	...
+	{ Chunk -- Stored in a file named $<hash of name>.<chunk index>
+		[Chunk data]
+	}
+	...
+*/
+
+namespace STORAGE {
+	class Filesystem; // Forward declare
+
+	namespace IO {
+		static const char STREAMMAGIC[] = { 'R','S','S','T','R','E','A','M' };
+
+		struct StreamManifest {
+			static const size_t SIZE = sizeof(STREAMMAGIC) + 3 * sizeof(FileSize);
+
+			FileSize size;			// Total number of bytes in the stream
+			FileSize chunkSize;		// The size of every chunk except (possibly) the last
+			FileSize numChunks;		// The number of chunk files
+		};
+
+		std::string chunkName(const std::string &, FileSize);
+		bool readManifest(Filesystem *, const std::string &, StreamManifest &);
+
+		/*
+		*  Stream writer class.
+		*  Writes an arbitrarily large object in fixed size chunks.  Chunks are written (and locked) one at a
+		*  time as they fill up, and the manifest is written when the stream is closed or destroyed.
+		*/
+		class StreamWriter {
+		public:
+			static const FileSize DEFAULT_CHUNK_SIZE = 1 << 24;	// 16MB per chunk
+
+			StreamWriter(Filesystem *, std::string, FileSize = DEFAULT_CHUNK_SIZE);
+			StreamWriter(StreamWriter &&);
+			StreamWriter(const StreamWriter &) = delete;
+			~StreamWriter();
+			void write(const char *, FileSize);
+			void close();
+			FileSize tell();
+		private:
+			void writeChunk();
+
+			Filesystem *fs;
+			std::string name;
+			std::vector<char> buffer;
+			StreamManifest manifest;
+			bool closed;
+		};
+
+		/*
+		*  Stream reader class.
+		*  Reads an object written by a StreamWriter into caller provided buffers.  Each chunk is locked for
+		*  reading only while it is being copied.
+		*/
+		class StreamReader {
+		public:
+			StreamReader(Filesystem *, std::string);
+			FileSize read(char *, FileSize);
+			void seek(FilePosition);
+			FilePosition tell();
+			FileSize size();
+		private:
+			Filesystem *fs;
+			std::string name;
+			StreamManifest manifest;
+			FilePosition position;
+		};
+	}
+}
+#endif
@@ -9,10 +9,11 @@
 #include "Filereader.h"
 #include "FileIOCommon.h"
 #include <assert.h>
+#include <algorithm>
 #include <future>
 
 // Constructor
-STORAGE::Filesystem::Filesystem(const char* fname) : file(fname), shuttingDown(false) {
+STORAGE::Filesystem::Filesystem(const char* fname) : file(fname), shuttingDown(false), pool(nullptr), columns(this) {
 	resetStats();
 	MVCC = false;
 
@@ -67,15 +68,18 @@ bool STORAGE::Filesystem::unlink(File f) {
 		// Overwrite the file with the last file
 		FilePosition lastFilePos = dir->files[dir->numFiles - 1];
 		FileHeader lastFileHeader = readHeader(lastFilePos);
-		File &lastFile = lookup[std::string(lastFileHeader.name)];
-		lock(lastFile, IO::EXCLUSIVE);
-		{
-			dir->files[f] = dir->files[lastFile];
-			dir->headers[f] = dir->headers[lastFile];
-			dir->locks[f] = dir->locks[lastFile];
-			lookup[std::string(dir->headers[lastFile].name)] = f;
+		File lastFile = lookup[std::string(lastFileHeader.name)];	// Copy, the lookup entry is overwritten below
+		if (lastFile != f) {	// Nothing to move if this is the last file
+			lock(lastFile, IO::EXCLUSIVE);
+			{
+				dir->files[f] = dir->files[lastFile];
+				dir->headers[f] = dir->headers[lastFile];
+				dir->locks[f] = dir->locks[lastFile];
+				dir->changes[f]++;
+				lookup[std::string(dir->headers[lastFile].name)] = f;
+			}
+			unlock(lastFile, IO::EXCLUSIVE);
 		}
-		unlock(lastFile, IO::EXCLUSIVE);
 
 		// Validate that the next header is valid.  Otherwise we cannot reclaim the space.
 		FileHeader nextHeader = readHeader(pos + size + FileHeader::SIZE);
@@ -85,7 +89,10 @@ bool STORAGE::Filesystem::unlink(File f) {
 			FileHeader &nextFileHeader = dir->headers[nextFile];
 			auto reader = getReader(nextFile);
 			auto writer = getWriter(nextFile);
-			lock(nextFile, IO::EXCLUSIVE);
+			bool held = nextFile == f;	// The file moved into this spot may be the one that follows
+			if (!held) {
+				lock(nextFile, IO::EXCLUSIVE);
+			}
 			{
 				char *buf = reader.readRaw();
 				dir->files[nextFile] = pos;	// Update the file position
@@ -93,7 +100,9 @@ bool STORAGE::Filesystem::unlink(File f) {
 				writer.write(buf, nextFileHeader.size);
 				writeHeader(nextFile);
 			}
-			unlock(nextFile, IO::EXCLUSIVE);
+			if (!held) {
+				unlock(nextFile, IO::EXCLUSIVE);
+			}
 			merged = true;
 		}
 	}
@@ -143,20 +152,25 @@ void STORAGE::Filesystem::writeHeader(FileHeader header, FilePosition pos) {
 		logEvent(ERROR, "Memory allocation failed.");
 		return;
 	}
+	packHeader(header, buffer);
+	file.raw_write(buffer, FileHeader::SIZE, pos);
+	free(buffer);
+}
+
+// Lay a header out as it is stored, in FileHeader::SIZE bytes
+void STORAGE::Filesystem::packHeader(const FileHeader &header, char *buffer) {
 	size_t offset = 0;
 	memcpy(buffer + offset, header.name, FileHeader::MAXNAMELEN);
 	offset += FileHeader::MAXNAMELEN;
 	memcpy(buffer + offset, &header.next, sizeof(FilePosition));
 	offset += sizeof(FilePosition);
-	memcpy(buffer + offset, reinterpret_cast<char*>(&header.size), sizeof(FileSize));
+	memcpy(buffer + offset, reinterpret_cast<const char*>(&header.size), sizeof(FileSize));
 	offset += sizeof(FileSize);
-	memcpy(buffer + offset, reinterpret_cast<char*>(&header.virtualSize), sizeof(FileSize));
+	memcpy(buffer + offset, reinterpret_cast<const char*>(&header.virtualSize), sizeof(FileSize));
 	offset += sizeof(FileSize);
-	memcpy(buffer + offset, reinterpret_cast<char*>(&header.version), sizeof(FileVersion));
+	memcpy(buffer + offset, reinterpret_cast<const char*>(&header.version), sizeof(FileVersion));
 	offset += sizeof(FileVersion);
-	memcpy(buffer + offset, reinterpret_cast<char*>(&header.timestamp), sizeof(std::chrono::milliseconds));
-	file.raw_write(buffer, FileHeader::SIZE, pos);
-	free(buffer);
+	memcpy(buffer + offset, reinterpret_cast<const char*>(&header.timestamp), sizeof(std::chrono::milliseconds));
 }
 
 // Write a files header to disk
@@ -264,6 +278,7 @@ File STORAGE::Filesystem::insertHeader(const char *name) {
 		// Setup directory
 		dir->headers[newFile] = header;
 		dir->files[newFile] = position;
+		dir->changes[newFile]++;
 		dir->numFiles++;
 
 		// Add file to lookup
@@ -276,6 +291,57 @@ File STORAGE::Filesystem::insertHeader(const char *name) {
 	return newFile;
 }
 
+// Place a batch of files after the last file and write it with a single write, creating the files that do not
+// exist yet.  Files that do exist are replaced as a relocating write would replace them, keeping their old
+// version behind them, and a name given twice takes its later entry.  No file is locked and the directory is not
+// written, so the caller must be the only user of the filesystem and must write the directory when it is done.
+void STORAGE::Filesystem::writeBatch(std::vector<char> &data, const std::vector<BatchEntry> &entries) {
+	std::lock_guard<std::mutex> sl(selectLock);
+	std::lock_guard<std::mutex> ig(insertGuard);
+
+	// Only count the new names when the batch might not fit.  Names used twice in the batch are counted twice, so
+	// this can only refuse a batch that would have fit.
+	if ((size_t)dir->nextSpot + entries.size() > MAXFILES) {
+		size_t created = 0;
+		for (const BatchEntry &entry : entries) {
+			created += lookup.find(entry.name) == lookup.end();
+		}
+		if ((size_t)dir->nextSpot + created > MAXFILES) {
+			throw IO::DirectoryFullException();
+		}
+	}
+	lookup.reserve(lookup.size() + entries.size());
+
+	FilePosition base = dir->nextRawSpot;
+	dir->nextRawSpot += data.size();
+	std::chrono::milliseconds now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+	for (const BatchEntry &entry : entries) {
+		FileHeader header;
+		memset(header.name, 0, FileHeader::MAXNAMELEN);
+		memcpy(header.name, entry.name.c_str(), std::min<size_t>(entry.name.size(), FileHeader::MAXNAMELEN - 1));
+		header.size = entry.size;
+		header.virtualSize = entry.size;
+		header.timestamp = now;
+
+		auto slot = lookup.emplace(entry.name, dir->nextSpot);
+		File f = slot.first->second;
+		if (slot.second) {
+			dir->nextSpot++;
+			dir->numFiles++;
+			header.next = 0;
+			header.version = 0;
+		} else {
+			header.next = dir->files[f];
+			header.version = dir->headers[f].version + 1;
+		}
+		dir->files[f] = base + entry.offset;
+		dir->headers[f] = header;
+		dir->changes[f]++;
+		packHeader(header, data.data() + entry.offset);
+	}
+	file.raw_write(data.data(), data.size(), base);
+}
+
 // Select a file from the filesystem to use.
 File &STORAGE::Filesystem::select(std::string fname) {
 	std::lock_guard<std::mutex> lk(selectLock);
@@ -284,13 +350,321 @@ File &STORAGE::Filesystem::select(std::string fname) {
 
 	// Check if the file exists.
 	if (!fileExists) {
-		// This potentially creates garbage if the user doesn't ever write to the file
+		// This potentially creates garbage if the user doesn't ever write to the file.
+		// Use find or tryGet to look up a file without creating it.
 		createNewFile(fname);
 	}
 
 	return lookup[fname];
 }
 
+// Find a file without creating it.  Returns NOFILE if the file does not exist.
+File STORAGE::Filesystem::find(std::string fname) {
+	std::lock_guard<std::mutex> lk(selectLock);
+	auto it = lookup.find(fname);
+	return it == lookup.end() ? NOFILE : it->second;
+}
+
+// Read the contents of a file if it exists and has been written.  Nothing is created on a miss.
+bool STORAGE::Filesystem::tryGet(std::string fname, std::string &out) {
+	File f = find(fname);
+	if (f == NOFILE || dir->headers[f].version == -1) {
+		return false;
+	}
+
+	IO::Reader reader = getReader(f);
+	lock(f, IO::SHARED);
+	{
+		out = reader.readString();
+	}
+	unlock(f, IO::SHARED);
+	return true;
+}
+
+// Write the contents of a file, creating the file on its first write
+void STORAGE::Filesystem::put(std::string fname, const char *data, FileSize size) {
+	File f = select(fname);
+	IO::SafeWriter writer = getSafeWriter(f);
+	writer.write(data, size);
+}
+
+// Read many files at once.  Names are resolved in one pass over the index, each file is locked once in
+// file order (so concurrent batches cannot deadlock), and the files are read in physical order.
+// Missing names are reported as not found and are not created.
+STORAGE::MultiGetResult STORAGE::Filesystem::multiGet(const std::vector<std::string> &names) {
+	MultiGetResult result;
+	size_t n = names.size();
+	std::vector<File> files(n);
+	result.offsets.assign(n, 0);
+	result.sizes.assign(n, 0);
+	result.found.assign(n, false);
+
+	{
+		std::lock_guard<std::mutex> lk(selectLock);
+		for (size_t i = 0; i < n; ++i) {
+			auto it = lookup.find(names[i]);
+			if (it != lookup.end()) {
+				files[i] = it->second;
+				result.found[i] = true;
+			}
+		}
+	}
+
+	std::vector<File> lockOrder;
+	std::vector<size_t> readOrder;
+	FileSize total = 0;
+	for (size_t i = 0; i < n; ++i) {
+		if (result.found[i]) {
+			lockOrder.push_back(files[i]);
+			readOrder.push_back(i);
+		}
+	}
+	std::sort(lockOrder.begin(), lockOrder.end());
+	lockOrder.erase(std::unique(lockOrder.begin(), lockOrder.end()), lockOrder.end());
+	std::sort(readOrder.begin(), readOrder.end(), [&](size_t a, size_t b) {
+		return dir->files[files[a]] < dir->files[files[b]];
+	});
+
+	for (File f : lockOrder) {
+		lock(f, IO::SHARED);
+	}
+	try {
+		for (size_t i : readOrder) {
+			total += dir->headers[files[i]].size;
+		}
+		result.arena.reserve(total);
+
+		for (size_t i : readOrder) {
+			IO::Reader reader = getReader(files[i]);
+			FileSize size = reader.remaining();
+			result.offsets[i] = result.arena.size();
+			result.sizes[i] = size;
+			result.arena.resize(result.arena.size() + size);
+			reader.read(result.arena.data() + result.offsets[i], size);
+		}
+	} catch (...) {
+		for (File f : lockOrder) {
+			unlock(f, IO::SHARED);
+		}
+		throw;
+	}
+	for (File f : lockOrder) {
+		unlock(f, IO::SHARED);
+	}
+
+	return result;
+}
+
+// Write many files at once.  Missing files are created in one pass over the index, each file is locked
+// once in file order, and the files are written in physical order.  If a name appears more than once
+// the last value wins.
+void STORAGE::Filesystem::multiPut(const std::vector<std::pair<std::string, std::string>> &pairs) {
+	std::map<File, size_t> last;	// Ordered by file, which is also the lock order
+	{
+		std::lock_guard<std::mutex> lk(selectLock);
+		for (size_t i = 0; i < pairs.size(); ++i) {
+			if (!exists(pairs[i].first)) {
+				createNewFile(pairs[i].first);
+			}
+			last[lookup[pairs[i].first]] = i;
+		}
+	}
+
+	std::vector<std::pair<FilePosition, File>> writeOrder;
+	for (auto &entry : last) {
+		lock(entry.first, IO::EXCLUSIVE);
+		writeOrder.push_back(std::make_pair(dir->files[entry.first], entry.first));
+	}
+	std::sort(writeOrder.begin(), writeOrder.end());
+
+	for (auto &entry : writeOrder) {
+		const std::string &value = pairs[last[entry.second]].second;
+		IO::Writer writer = getWriter(entry.second);
+		writer.write(value.c_str(), value.size());
+	}
+
+	for (auto &entry : last) {
+		unlock(entry.first, IO::EXCLUSIVE);
+	}
+}
+
+// Visit every file using the thread pool.  The files are sorted by position and cut into ranges of about the
+// same number of bytes, which are scanned with parallelFor, so each range is read front to back.  A file is
+// copied out under a shared lock and the callback runs after the lock is released, so it sees one complete
+// version of the file and may write to it.  Files created or unlinked during the scan may or may not be visited.
+// Returns the number of files visited; the first exception thrown by the callback stops the scan and is rethrown.
+size_t STORAGE::Filesystem::parallelForEach(ForEachFunction fn) {
+	struct Entry {
+		FilePosition position;
+		File file;
+		std::string name;
+	};
+
+	THREADING::ThreadPool *workers = getPool();
+	std::vector<Entry> entries;
+	std::vector<size_t> bounds;		// Range i covers entries[bounds[i], bounds[i + 1])
+	std::atomic<size_t> visited(0);
+
+	FileSize total = 0;
+	{
+		std::lock_guard<std::mutex> lk(selectLock);
+		std::lock_guard<std::mutex> dl(dirLock);
+		entries.reserve(dir->numFiles);
+		for (File f = 0; f < dir->numFiles; ++f) {
+			FileHeader &header = dir->headers[f];
+			entries.push_back(Entry{ dir->files[f], f, std::string(header.name, strnlen(header.name, FileHeader::MAXNAMELEN)) });
+			total += header.size + FileHeader::SIZE;
+		}
+	}
+	if (entries.empty()) {
+		return 0;
+	}
+	std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+		return a.position < b.position;
+	});
+
+	// A few ranges per worker so that a range of large files does not hold up the end of the scan
+	FileSize target = std::max<FileSize>(total / (workers->workerCount() * 4 + 1), 1);
+	FileSize bytes = 0;
+	bounds.push_back(0);
+	for (size_t i = 0; i < entries.size(); ++i) {
+		bytes += dir->headers[entries[i].file].size + FileHeader::SIZE;
+		if (bytes >= target) {
+			bounds.push_back(i + 1);
+			bytes = 0;
+		}
+	}
+	if (bounds.back() != entries.size()) {
+		bounds.push_back(entries.size());
+	}
+
+	parallelFor(bounds.size() - 1, [&](size_t range) {
+		std::vector<char> buffer;
+		for (size_t i = bounds[range]; i < bounds[range + 1]; ++i) {
+			const Entry &entry = entries[i];
+			FileSize size = 0;
+			bool present;
+			lock(entry.file, IO::SHARED);
+			try {
+				// Skip files that were unlinked, or moved by an unlink, since the listing was taken
+				present = strncmp(dir->headers[entry.file].name, entry.name.c_str(), FileHeader::MAXNAMELEN) == 0;
+				if (present) {
+					IO::Reader reader = getReader(entry.file);
+					size = reader.remaining();
+					buffer.resize(size);
+					reader.read(buffer.data(), size);
+				}
+			} catch (...) {
+				unlock(entry.file, IO::SHARED);
+				throw;
+			}
+			unlock(entry.file, IO::SHARED);
+
+			if (present) {
+				fn(entry.file, entry.name, buffer.data(), size);
+				visited++;
+			}
+		}
+	});
+	return visited;
+}
+
+// Run fn(0) to fn(count - 1) on the thread pool.  The workers and the caller claim indices one at a time, and
+// the call returns once every claimed index is done.  The first exception thrown stops indices from being
+// handed out and is rethrown.
+void STORAGE::Filesystem::parallelFor(size_t count, std::function<void(size_t)> fn) {
+	struct Loop {
+		std::function<void(size_t)> fn;
+		std::mutex mutex;				// Guards everything below
+		std::condition_variable done;
+		size_t next;					// The next unclaimed index
+		size_t active;					// Indices being run
+		std::exception_ptr error;
+	};
+
+	if (count == 0) {
+		return;
+	}
+	THREADING::ThreadPool *workers = getPool();
+	std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+	loop->fn = fn;
+	loop->next = 0;
+	loop->active = 0;
+
+	// Helpers hold the loop alive on their own, so the caller never waits for a helper that has not started
+	auto work = [loop, count] {
+		while (true) {
+			size_t index;
+			{
+				std::lock_guard<std::mutex> lk(loop->mutex);
+				if (loop->next >= count) {
+					return;
+				}
+				index = loop->next++;
+				loop->active++;
+			}
+
+			try {
+				loop->fn(index);
+			} catch (...) {
+				std::lock_guard<std::mutex> lk(loop->mutex);
+				if (!loop->error) {
+					loop->error = std::current_exception();
+				}
+				loop->next = count;	// Stop handing out indices
+			}
+
+			std::lock_guard<std::mutex> lk(loop->mutex);
+			if (--loop->active == 0 && loop->next >= count) {
+				loop->done.notify_all();
+			}
+		}
+	};
+
+	size_t helpers = std::min(workers->workerCount(), count - 1);
+	if (helpers > 0) {
+		std::vector<std::function<void()>> tasks(helpers, work);
+		workers->enqueueBulk(tasks.begin(), tasks.end());
+	}
+	work();
+
+	std::unique_lock<std::mutex> lk(loop->mutex);
+	loop->done.wait(lk, [&] { return loop->active == 0 && loop->next >= count; });
+	if (loop->error) {
+		std::rethrow_exception(loop->error);
+	}
+}
+
+// Run a query over every file.  Each file is checked on a worker, straight from the copy the scan makes of it,
+// and only matches are handed over.  Returns the number of matches.
+size_t STORAGE::Filesystem::query(const IO::Query &query, QueryFunction fn) {
+	std::mutex deliver;
+	size_t matched = 0;
+	parallelForEach([&](File f, const std::string &name, const char *data, FileSize size) {
+		IO::PooledAllocator allocator;
+		std::vector<JsonValue> fields;
+		if (!query.match(JsonCursor(data, size), fields, *allocator)) {
+			return;
+		}
+		std::lock_guard<std::mutex> lk(deliver);
+		fn(f, name, fields);
+		matched++;
+	});
+	return matched;
+}
+
+void STORAGE::Filesystem::registerColumn(const std::string &path, IO::ColumnType type) {
+	columns.add(path, type);
+}
+
+STORAGE::IO::Aggregate STORAGE::Filesystem::aggregate(const std::string &path) {
+	return columns.aggregate(path);
+}
+
+std::map<std::string, STORAGE::IO::Aggregate> STORAGE::Filesystem::aggregate(const std::string &path, const std::string &keyPath) {
+	return columns.aggregate(path, keyPath);
+}
+
 // Lock the file for either read or write
 void STORAGE::Filesystem::lock(File file, IO::LockType type) {
 	std::thread::id id = std::this_thread::get_id();
@@ -308,36 +682,69 @@ void STORAGE::Filesystem::lock(File file, IO::LockType type) {
 	{
 	std::unique_lock<std::mutex> lk(dirLock);
 		// Wait until the file is available
-		fl.cond.wait(lk, [&] 
-		{
-			if (shuttingDown) { return true; }
-
-			// Special cases for multiversion concurrency control
-			if (MVCC) {
-				if (type == IO::SHARED) {
-					// If the file is unlocked with no writers, we can immediately read
-					bool readUnlockTest = fl.writers == 0 && dir->headers[file].version > -1;
-					if (readUnlockTest) { return true; }
-					// If there are writers, but there is a previous version available, we can read it
-					bool readLockTest = fl.writers > 0 && dir->headers[file].version > 0;
-					if (readLockTest) { return true; }
-				} else if (type == IO::EXCLUSIVE) {
-					// The file will get a new version, immediately stop waiting
-					return true;
-				}
-			} else {
-				// If we want read (non-exclusive) access, there must not be any writers
-				bool readTest = type == IO::SHARED && fl.writers == 0;
-				if (readTest) { return true; }
-
-				// If we want write (exclusive) access, there must not be any unlocked readers or locked writers
-				bool writeTest = type == IO::EXCLUSIVE && fl.readers == 0 && fl.writers == 0;
-				if (writeTest) { return true; }
-			}
+		fl.cond.wait(lk, [&] { return lockable(file, type); });
 
-			// Keep waiting
-			return false;
-		});
+		if (type == IO::EXCLUSIVE) {
+			fl.writers++;
+		} else if (type == IO::SHARED) {
+			fl.readers++;
+		}
+	}
+}
+
+// Whether a thread holds the file for writing.  Lock counts are only read under dirLock, which belongs to this
+// translation unit.
+bool STORAGE::Filesystem::hasWriter(File file) {
+	std::unique_lock<std::mutex> lk(dirLock);
+	return dir->locks[file].writers > 0;
+}
+
+// Whether a lock could be taken right now.  The caller holds dirLock.
+bool STORAGE::Filesystem::lockable(File file, IO::LockType type) {
+	FileLock &fl = dir->locks[file];
+	if (shuttingDown) { return true; }
+
+	// Special cases for multiversion concurrency control
+	if (MVCC) {
+		if (type == IO::SHARED) {
+			// If the file is unlocked with no writers, we can immediately read
+			bool readUnlockTest = fl.writers == 0 && dir->headers[file].version > -1;
+			if (readUnlockTest) { return true; }
+			// If there are writers, but there is a previous version available, we can read it
+			bool readLockTest = fl.writers > 0 && dir->headers[file].version > 0;
+			if (readLockTest) { return true; }
+		} else if (type == IO::EXCLUSIVE) {
+			// The file will get a new version, immediately stop waiting
+			return true;
+		}
+	} else {
+		// If we want read (non-exclusive) access, there must not be any writers
+		bool readTest = type == IO::SHARED && fl.writers == 0;
+		if (readTest) { return true; }
+
+		// If we want write (exclusive) access, there must not be any unlocked readers or locked writers
+		bool writeTest = type == IO::EXCLUSIVE && fl.readers == 0 && fl.writers == 0;
+		if (writeTest) { return true; }
+	}
+
+	// Keep waiting
+	return false;
+}
+
+// Take a lock without blocking.  If the lock is free the callback is queued on the pool straight away,
+// otherwise it is queued on the file and started by the unlock that frees the lock.  The callback runs
+// with the lock held and is responsible for unlocking.
+void STORAGE::Filesystem::lockAsync(File file, IO::LockType type, std::function<void()> granted) {
+	THREADING::ThreadPool *workers = getPool();
+	FileLock &fl = dir->locks[file];
+	{
+		std::unique_lock<std::mutex> lk(dirLock);
+		// Wait behind earlier waiters so that a stream of readers cannot starve a writer
+		auto it = waiters.find(file);
+		if ((it != waiters.end() && !it->second.empty()) || !lockable(file, type)) {
+			waiters[file].push_back(LockWaiter{ type, std::move(granted) });
+			return;
+		}
 
 		if (type == IO::EXCLUSIVE) {
 			fl.writers++;
@@ -345,6 +752,7 @@ void STORAGE::Filesystem::lock(File file, IO::LockType type) {
 			fl.readers++;
 		}
 	}
+	workers->enqueue(std::move(granted));
 }
 
 void STORAGE::Filesystem::unlock(File file, IO::LockType type) {
@@ -359,6 +767,7 @@ void STORAGE::Filesystem::unlock(File file, IO::LockType type) {
 #endif
 
 	FileLock &fl = dir->locks[file];
+	std::vector<std::function<void()>> granted;
 	{
 		std::unique_lock<std::mutex> lk(dirLock);
 		if (type == IO::EXCLUSIVE) {
@@ -366,9 +775,47 @@ void STORAGE::Filesystem::unlock(File file, IO::LockType type) {
 		} else if (type == IO::SHARED) {
 			fl.readers--;
 		}
+
+		// Hand the lock to asynchronous waiters in the order they asked for it
+		auto it = waiters.find(file);
+		if (it != waiters.end()) {
+			std::deque<LockWaiter> &queue = it->second;
+			while (!queue.empty() && lockable(file, queue.front().type)) {
+				if (queue.front().type == IO::EXCLUSIVE) {
+					fl.writers++;
+				} else if (queue.front().type == IO::SHARED) {
+					fl.readers++;
+				}
+				granted.push_back(std::move(queue.front().granted));
+				queue.pop_front();
+			}
+			if (queue.empty()) {
+				waiters.erase(it);
+			}
+		}
 	}
 	fl.cond.notify_one();
 
+	if (!granted.empty()) {
+		// Held while queueing so that shutdown cannot take the pool away in the meantime
+		bool queued = false;
+		{
+			std::lock_guard<std::mutex> lk(poolLock);
+			if (pool != nullptr) {
+				try {
+					pool->enqueueBulk(granted.begin(), granted.end());
+					queued = true;
+				} catch (std::runtime_error &) {}
+			}
+		}
+		if (!queued) {
+			// The pool is gone or draining for shutdown, finish the waiters here
+			for (auto &fn : granted) {
+				fn();
+			}
+		}
+	}
+
 	std::ostringstream os2;
 	os2 << "Thread " << id << " unlocked " << file;
 	logEvent(THREAD, os2.str());
@@ -423,11 +870,106 @@ size_t STORAGE::Filesystem::count(CountType type) {
 }
 
 void STORAGE::Filesystem::shutdown(int code) {
-	shuttingDown = true;
+	// Let queued asynchronous IO finish before the backing file goes away.  The pool is joined without poolLock
+	// held, since a task it is draining may still ask for the pool.
+	THREADING::ThreadPool *stopping;
+	{
+		std::lock_guard<std::mutex> lk(poolLock);
+		stopping = pool;
+		pool = nullptr;
+		shuttingDown = true;
+	}
+	delete stopping;
 	writeFileDirectory(dir); // Make sure that any changes to the directory are flushed to disk.
 	file.shutdown(code);
 }
 
+// Read an entire file without blocking the caller
+std::future<std::string> STORAGE::Filesystem::readAsync(File f) {
+	auto task = std::make_shared<std::packaged_task<std::string()>>([this, f] {
+		IO::Reader reader = getReader(f);
+		return reader.readString();
+	});
+	submitIO(f, IO::SHARED, [task] { (*task)(); });
+	return task->get_future();
+}
+
+// Replace the contents of a file without blocking the caller
+std::future<void> STORAGE::Filesystem::writeAsync(File f, std::string data) {
+	auto task = std::make_shared<std::packaged_task<void()>>([this, f, data] {
+		IO::Writer writer = getWriter(f);
+		writer.write(data.c_str(), data.size());
+	});
+	submitIO(f, IO::EXCLUSIVE, [task] { (*task)(); });
+	return task->get_future();
+}
+
+std::future<File> STORAGE::Filesystem::selectAsync(std::string fname) {
+	return getPool()->enqueue([this, fname] { return select(fname); });
+}
+
+// Queue an operation for a file.  If nobody is draining the file's queue, start a drain on the pool.
+void STORAGE::Filesystem::submitIO(File f, IO::LockType type, std::function<void()> op) {
+	// Throws once shutting down, before anything is queued that no drain would ever run
+	THREADING::ThreadPool *workers = getPool();
+	bool start;
+	{
+		std::lock_guard<std::mutex> lk(pendingLock);
+		start = pending.find(f) == pending.end();
+		pending[f].push_back(PendingIO{ type, std::move(op) });
+	}
+
+	if (start) {
+		try {
+			workers->enqueue([this, f] { drainIO(f); });
+		} catch (std::runtime_error &) {
+			// The pool is draining for shutdown, drain the file here
+			drainIO(f);
+		}
+	}
+}
+
+// Run queued operations for a file until the queue is empty.  Consecutive operations that need the same
+// kind of lock run under one lock, in the order they were submitted.
+void STORAGE::Filesystem::drainIO(File f) {
+	while (true) {
+		std::deque<PendingIO> batch;
+		{
+			std::lock_guard<std::mutex> lk(pendingLock);
+			auto it = pending.find(f);
+			if (it->second.empty()) {
+				pending.erase(it);
+				return;
+			}
+			batch.swap(it->second);
+		}
+
+		size_t i = 0;
+		while (i < batch.size()) {
+			IO::LockType type = batch[i].type;
+			lock(f, type);
+			{
+				for (; i < batch.size() && batch[i].type == type; ++i) {
+					batch[i].op();
+				}
+			}
+			unlock(f, type);
+		}
+	}
+}
+
+THREADING::ThreadPool *STORAGE::Filesystem::getPool() {
+	std::lock_guard<std::mutex> lk(poolLock);
+	if (shuttingDown) {
+		throw std::runtime_error("asynchronous IO on a filesystem that is shutting down");
+	}
+	if (pool == nullptr) {
+		size_t threads = std::thread::hardware_concurrency();
+		pool = new THREADING::ThreadPool(threads > 0 ? threads : 1);
+	}
+	return pool;
+}
+
 void STORAGE::Filesystem::writeFileDirectory(FileDirectory *fd) {
 	logEvent(EVENT, "Writing file directory");
 	char *buffer = (char*)malloc(FileDirectory::SIZE);
@@ -501,6 +1043,30 @@ STORAGE::IO::SafeReader STORAGE::Filesystem::getSafeReader(File f) {
 	return IO::SafeReader(this, f);
 }
 
+STORAGE::IO::BufferedWriter STORAGE::Filesystem::getBufferedWriter(File f, FileSize threshold) {
+	return IO::BufferedWriter(this, f, threshold);
+}
+
+STORAGE::IO::StreamWriter STORAGE::Filesystem::getStreamWriter(std::string name, FileSize chunkSize) {
+	return IO::StreamWriter(this, name, chunkSize);
+}
+
+STORAGE::IO::StreamReader STORAGE::Filesystem::getStreamReader(std::string name) {
+	return IO::StreamReader(this, name);
+}
+
+STORAGE::IO::DocumentWriter STORAGE::Filesystem::getDocumentWriter(File f) {
+	return IO::DocumentWriter(this, f);
+}
+
+STORAGE::IO::DocumentReader STORAGE::Filesystem::getDocumentReader(File f) {
+	return IO::DocumentReader(this, f);
+}
+
+STORAGE::IO::Importer STORAGE::Filesystem::getImporter(IO::ImportOptions options) {
+	return IO::Importer(this, options);
+}
+
 STORAGE::FileHeader STORAGE::Filesystem::getHeader(File f) {
 	return dir->headers[f];
 }
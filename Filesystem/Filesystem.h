@@ -13,13 +13,27 @@
 #include "Logging.h"
 #include "Filewriter.h"
 #include "Filereader.h"
+#include "Filestream.h"
+#include "Filedocument.h"
+#include "Fileimport.h"
+#include "Filebuilder.h"
+#include "Filequery.h"
+#include "Filecolumn.h"
+#include "Filecoroutine.h"
 #include "FileIOCommon.h"
+#include "ThreadPool.h"
 
 #include <cstring>
 #include <array>
+#include <deque>
+#include <functional>
+#include <future>
 #include <limits>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <queue>
+#include <vector>
 #include <mutex>
 #include <thread>
 #include <chrono>
@@ -62,19 +76,35 @@ namespace STORAGE {
 		friend class IO::Writer;
 		friend class IO::Reader;
 		friend class IO::FileIO;
+		friend class IO::Importer;
+		friend class IO::StoreBuilder;
+		friend class IO::ColumnCache;
+#ifdef RAPIDSTASH_COROUTINES
+		friend class IO::ScheduleAwaiter;
+#endif
 
 	public:
 		Filesystem(const char* fname);
-		~Filesystem() { free(dir); }
+		~Filesystem() { delete pool; free(dir); }
 		void shutdown(int code = SUCCESS);
 		File &select(std::string);
+		File find(std::string);
+		bool tryGet(std::string, std::string &);
+		void put(std::string, const char *, FileSize);
 		void lock(File, IO::LockType);
 		void unlock(File, IO::LockType);
+		void lockAsync(File, IO::LockType, std::function<void()>);
 		FileHeader getHeader(File);
 		IO::Writer getWriter(File);
 		IO::Reader getReader(File);
 		IO::SafeWriter getSafeWriter(File);
 		IO::SafeReader getSafeReader(File);
+		IO::BufferedWriter getBufferedWriter(File, FileSize = IO::BufferedWriter::DEFAULT_THRESHOLD);
+		IO::StreamWriter getStreamWriter(std::string, FileSize = IO::StreamWriter::DEFAULT_CHUNK_SIZE);
+		IO::StreamReader getStreamReader(std::string);
+		IO::DocumentWriter getDocumentWriter(File);
+		IO::DocumentReader getDocumentReader(File);
+		IO::Importer getImporter(IO::ImportOptions = IO::ImportOptions());
 		size_t count(CountType);
 		double getThroughput(CountType);
 		bool exists(std::string);
@@ -84,6 +114,39 @@ namespace STORAGE {
 		void resetStats();
 		bool unlink(File);
 
+		// Asynchronous IO, executed by a thread pool owned by the filesystem
+		std::future<std::string> readAsync(File);
+		std::future<void> writeAsync(File, std::string);
+		std::future<File> selectAsync(std::string);
+
+		// Batched IO
+		MultiGetResult multiGet(const std::vector<std::string> &);
+		void multiPut(const std::vector<std::pair<std::string, std::string>> &);
+
+		// Whole store scans.  The callback is given the file, its name and a copy of its contents.
+		typedef std::function<void(File, const std::string &, const char *, FileSize)> ForEachFunction;
+		size_t parallelForEach(ForEachFunction);
+
+		// Queries, run as a scan.  The callback is given each matching file, its name and the selected fields, which
+		// are only valid during the call.  Calls are made one at a time, from the pool, in no particular order.
+		typedef std::function<void(File, const std::string &, const std::vector<JsonValue> &)> QueryFunction;
+		size_t query(const IO::Query &, QueryFunction);
+
+		// Aggregates of a field over every document, from a cache of the field that is brought up to date with the
+		// files written since it was last used.  Fields must be registered first, as NUMBERS or as KEYS to group by.
+		void registerColumn(const std::string &, IO::ColumnType = IO::NUMBERS);
+		IO::Aggregate aggregate(const std::string &);
+		std::map<std::string, IO::Aggregate> aggregate(const std::string &, const std::string &);
+
+#ifdef RAPIDSTASH_COROUTINES
+		// Coroutine IO.  Waiting for a lock suspends the coroutine instead of blocking a thread, and the
+		// coroutine carries on on the filesystem's pool.
+		IO::LockAwaiter lockAsync(File, IO::LockType);
+		IO::ScheduleAwaiter schedule();
+		IO::Async<std::string> read(std::string);
+		IO::Async<void> write(std::string, std::string);
+#endif
+
 	protected:
 		DynamicMemoryMappedFile file;
 		void writeFileDirectory(FileDirectory *);
@@ -95,16 +158,99 @@ namespace STORAGE {
 		FileHeader readHeader(FilePosition);
 		void writeHeader(File);
 		void writeHeader(FileHeader, FilePosition);
+		static void packHeader(const FileHeader &, char *);
+		void writeBatch(std::vector<char> &, const std::vector<BatchEntry> &);
 		File createNewFile(std::string);
+		bool lockable(File, IO::LockType);
+		bool hasWriter(File);
 		
 		// For quick lookups, map filenames to spot in meta table.
-		std::map<std::string, File> lookup;
+		std::unordered_map<std::string, File> lookup;
 
 		// Toggle multiversion concurrency control
 		bool MVCC;
 
 		bool shuttingDown;
+
+		// Asynchronous IO.  Operations are queued per file and a single pool task drains the queue,
+		// so a burst of operations on one file is not handed back and forth between threads.
+		struct PendingIO {
+			IO::LockType type;
+			std::function<void()> op;
+		};
+		void submitIO(File, IO::LockType, std::function<void()>);
+		void drainIO(File);
+		THREADING::ThreadPool *getPool();
+		THREADING::ThreadPool *pool;
+		std::mutex poolLock;
+		std::mutex pendingLock;
+		std::map<File, std::deque<PendingIO>> pending;
+
+		// Callbacks waiting in lockAsync, started by unlock.  Guarded by dirLock.
+		struct LockWaiter {
+			IO::LockType type;
+			std::function<void()> granted;
+		};
+		std::map<File, std::deque<LockWaiter>> waiters;
+
+		// Run tasks on the pool, with the caller taking part
+		void parallelFor(size_t, std::function<void(size_t)>);
+
+		IO::ColumnCache columns;
 	};
+
+#ifdef RAPIDSTASH_COROUTINES
+	inline void IO::LockAwaiter::await_suspend(std::coroutine_handle<> caller) {
+		fs->lockAsync(file, type, [caller] { caller.resume(); });
+	}
+
+	inline void IO::ScheduleAwaiter::await_suspend(std::coroutine_handle<> caller) {
+		fs->getPool()->enqueue([caller] { caller.resume(); });
+	}
+
+	inline IO::LockAwaiter Filesystem::lockAsync(File f, IO::LockType type) {
+		return IO::LockAwaiter(this, f, type);
+	}
+
+	inline IO::ScheduleAwaiter Filesystem::schedule() {
+		return IO::ScheduleAwaiter(this);
+	}
+
+	// Read an entire file.  Throws a FileNotFoundException if the file does not exist or was never written.
+	inline IO::Async<std::string> Filesystem::read(std::string fname) {
+		File f = find(fname);
+		if (f == NOFILE || dir->headers[f].version == -1) {
+			throw IO::FileNotFoundException();
+		}
+
+		co_await lockAsync(f, IO::SHARED);
+		std::string data;
+		try {
+			IO::Reader reader = getReader(f);
+			data = reader.readString();
+		} catch (...) {
+			unlock(f, IO::SHARED);
+			throw;
+		}
+		unlock(f, IO::SHARED);
+		co_return data;
+	}
+
+	// Replace the contents of a file, creating it if needed
+	inline IO::Async<void> Filesystem::write(std::string fname, std::string data) {
+		File f = select(fname);
+
+		co_await lockAsync(f, IO::EXCLUSIVE);
+		try {
+			IO::Writer writer = getWriter(f);
+			writer.write(data.c_str(), data.size());
+		} catch (...) {
+			unlock(f, IO::EXCLUSIVE);
+			throw;
+		}
+		unlock(f, IO::EXCLUSIVE);
+	}
+#endif
 }
 
 #endif
@@ -6,6 +6,8 @@
 
 #include <array>
 #include <atomic>
+#include <string>
+#include <vector>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
@@ -19,6 +21,7 @@ namespace STORAGE {
 	static std::mutex selectLock;
 
 	static const size_t MAXFILES = 2 << 19; // 1MB entries at 8 bytes per entry == 8MB file directory
+	static const File NOFILE = -1;			// Returned by lookups that do not find a file
 
 	struct FileLock {
 		std::condition_variable cond;	// Condition variable to wait on
@@ -64,9 +67,14 @@ namespace STORAGE {
 														// Extra stuff
 		std::array<FileLock, MAXFILES> locks;			// Per-file concurrency
 		std::array<FileHeader, MAXFILES> headers;		// The headers contain the filename and file size
+		std::array<std::atomic<unsigned int>, MAXFILES> changes;	// Bumped by every write (in place or not), for caches of file contents that read it without locking.  Not stored.
 
 														// Methods
-		FileDirectory() : numFiles(0), nextSpot(0), tempList(0), nextRawSpot(SIZE) {}
+		FileDirectory() : numFiles(0), nextSpot(0), tempList(0), nextRawSpot(SIZE) {
+			for (auto &change : changes) {
+				change = 0;
+			}
+		}
 
 		/*
 		*  Statics
@@ -74,6 +82,25 @@ namespace STORAGE {
 		static const size_t SIZE = sizeof(FileIndex) + sizeof(File) + (2 * sizeof(FilePosition)) + (sizeof(FilePosition) * MAXFILES);
 	};
 
+	// The result of a batched read.  The contents of every file are stored back to back in a single arena.
+	struct MultiGetResult {
+		std::vector<char> arena;
+		std::vector<FilePosition> offsets;	// Where each result starts in the arena
+		std::vector<FileSize> sizes;		// The size of each result
+		std::vector<bool> found;			// Whether each name exists
+
+		const char *data(size_t i) const { return arena.data() + offsets[i]; }
+		std::string get(size_t i) const { return std::string(data(i), sizes[i]); }
+	};
+
+	// A file in a batch written by Filesystem::writeBatch.  The batch holds each file's header and data back to
+	// back, and the header is filled in when the batch is written.
+	struct BatchEntry {
+		FilePosition offset;	// Of the file's header within the batch
+		FileSize size;			// Of the file's data
+		std::string name;
+	};
+
 	// Statistics for writes and reads
 	enum CountType {
 		BYTESWRITTEN,
@@ -15,6 +15,57 @@ void STORAGE::IO::SafeWriter::write(const char *data, FileSize size) {
 	fs->unlock(file, EXCLUSIVE);
 }
 
+/*
+ *  Buffered (coalescing, auto-locking) file writer utility class
+ */
+STORAGE::IO::BufferedWriter::BufferedWriter(STORAGE::Filesystem *fs_, File file_, FileSize threshold_) : Writer(fs_, file_), threshold(threshold_) {
+	buffer.reserve(threshold);
+}
+
+STORAGE::IO::BufferedWriter::BufferedWriter(BufferedWriter &&other) : Writer(other), buffer(std::move(other.buffer)), threshold(other.threshold) {
+	other.buffer.clear();
+}
+
+STORAGE::IO::BufferedWriter::~BufferedWriter() {
+	flush();
+}
+
+void STORAGE::IO::BufferedWriter::write(const char *data, FileSize size) {
+	// Large writes with nothing pending gain nothing from a copy into the buffer
+	if (buffer.empty() && size >= threshold) {
+		fs->lock(file, EXCLUSIVE);
+		{
+			Writer::write(data, size);
+		}
+		fs->unlock(file, EXCLUSIVE);
+		return;
+	}
+
+	buffer.insert(buffer.end(), data, data + size);
+	if (buffer.size() >= threshold) {
+		flush();
+	}
+}
+
+void STORAGE::IO::BufferedWriter::flush() {
+	if (buffer.empty()) {
+		return;
+	}
+
+	fs->lock(file, EXCLUSIVE);
+	{
+		Writer::write(buffer.data(), buffer.size());
+	}
+	fs->unlock(file, EXCLUSIVE);
+
+	// Keep the capacity around for the next batch
+	buffer.clear();
+}
+
+FileSize STORAGE::IO::BufferedWriter::pending() {
+	return buffer.size();
+}
+
 /*
  *  File writer utility class
  */
@@ -54,6 +105,7 @@ void STORAGE::IO::Writer::write(const char *data, FileSize size) {
 		fs->file.raw_write(data, size, oldLoc + position + STORAGE::FileHeader::SIZE);
 	}
 
+	fs->dir->changes[file]++;
 	bytesWritten += size + STORAGE::FileHeader::SIZE;
 	numWrites++;
 	position += size;
@@ -65,3 +117,34 @@ void STORAGE::IO::Writer::write(const char *data, FileSize size) {
 		writeTime.store(writeTime.load() + time_span.count());
 	}
 }
+
+// Hand over the version of the file that writes apply to (the newest), which readers skip while it is being
+// written under MVCC.  The data is only valid inside the callback.
+void STORAGE::IO::Writer::current(std::function<void(const char *, FileSize)> fn) {
+	FileSize size = fs->dir->headers[file].size;
+	fs->file.raw_view(fs->dir->files[file] + STORAGE::FileHeader::SIZE, size, [&](const char *data) { fn(data, size); });
+}
+
+// Replace bytes within the file without changing its size or moving it.  The old bytes are lost, so this is
+// only for writes that need not preserve the previous version (MVCC disabled).
+void STORAGE::IO::Writer::overwrite(FilePosition offset, const char *data, FileSize size) {
+	TimePoint start;
+	if (timingEnabled) {
+		start = Clock::now();
+	}
+
+	fs->dir->headers[file].timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+	fs->writeHeader(file);
+	fs->file.raw_write(data, size, fs->dir->files[file] + offset + STORAGE::FileHeader::SIZE);
+
+	fs->dir->changes[file]++;
+	bytesWritten += size;
+	numWrites++;
+
+	lastHeader = fs->dir->headers[file];
+
+	if (timingEnabled) {
+		TimeSpan time_span = std::chrono::duration_cast<TimeSpan>(Clock::now() - start);
+		writeTime.store(writeTime.load() + time_span.count());
+	}
+}
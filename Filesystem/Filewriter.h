@@ -6,6 +6,9 @@
 #include "FilesystemCommon.h"
 #include "FileIOCommon.h"
 
+#include <functional>
+#include <vector>
+
 namespace STORAGE{
 	class Filesystem;	// Forward declare
 	namespace IO {
@@ -18,6 +21,9 @@ namespace STORAGE{
 		public:
 			Writer(Filesystem *, File);
 			void write(const char *, FileSize);
+		protected:
+			void current(std::function<void(const char *, FileSize)>);
+			void overwrite(FilePosition, const char *, FileSize);
 		};
 
 		class SafeWriter : public Writer {
@@ -25,6 +31,29 @@ namespace STORAGE{
 			SafeWriter(Filesystem *, File);
 			void write(const char *, FileSize);
 		};
+
+		/*
+		*  Buffered writer class.
+		*  Coalesces many small writes into a single Writer::write, so the header is rewritten once per flush
+		*  instead of once per write.  The buffer is flushed when it reaches the threshold, when flush() is called,
+		*  or when the writer is destroyed.  Flushing takes an exclusive lock on the file, so the user must not be
+		*  holding one.  The buffer is not shared, so each thread should use its own BufferedWriter.
+		*/
+		class BufferedWriter : public Writer {
+		public:
+			static const FileSize DEFAULT_THRESHOLD = 1 << 16;	// Flush once 64k is buffered
+
+			BufferedWriter(Filesystem *, File, FileSize = DEFAULT_THRESHOLD);
+			BufferedWriter(BufferedWriter &&);
+			BufferedWriter(const BufferedWriter &) = delete;
+			~BufferedWriter();
+			void write(const char *, FileSize);
+			void flush();
+			FileSize pending();
+		private:
+			std::vector<char> buffer;
+			FileSize threshold;
+		};
 	}
 }
 
@@ -0,0 +1,71 @@
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#include <FileSystem.h>
+
+#include <chrono>
+
+void usage() {
+	std::cout << "Usage: Import <store> <input.ndjson> [--key path] [--prefix prefix] [--text] [--chunk bytes]" << std::endl;
+	std::cout << "  --key     Name each document by the member at path, rather than by its line number" << std::endl;
+	std::cout << "  --prefix  Prepended to every name" << std::endl;
+	std::cout << "  --text    Store each line as it was given, rather than as a tape" << std::endl;
+	std::cout << "  --chunk   Bytes of input parsed and written at a time" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 3) {
+		usage();
+		return 1;
+	}
+
+	STORAGE::IO::ImportOptions options;
+	for (int i = 3; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--key" && i + 1 < argc) {
+			options.keyPath = argv[++i];
+		} else if (arg == "--prefix" && i + 1 < argc) {
+			options.prefix = argv[++i];
+		} else if (arg == "--chunk" && i + 1 < argc) {
+			options.chunkSize = strtoull(argv[++i], nullptr, 10);
+		} else if (arg == "--text") {
+			options.tape = false;
+		} else {
+			usage();
+			return 1;
+		}
+	}
+
+	STORAGE::Filesystem fs(argv[1]);
+	STORAGE::IO::ImportResult result;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	try {
+		result = fs.getImporter(options).import(std::string(argv[2]));
+	}
+	catch (std::exception &e) {
+		std::cout << "Import failed: " << e.what() << std::endl;
+		fs.shutdown();
+		return 1;
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / 1000.0;
+
+	std::cout << "Imported " << result.documents << " documents (" << result.bytes << " bytes) in " << seconds << " seconds, "
+		<< result.bytes / (1024.0 * 1024.0) / (0.001 + seconds) << " MB/s" << std::endl;
+	if (result.rejected > 0) {
+		std::cout << "Rejected " << result.rejected << " lines:";
+		for (size_t line : result.rejectedLines) {
+			std::cout << " " << line;
+		}
+		if (result.rejected > result.rejectedLines.size()) {
+			std::cout << " ...";
+		}
+		std::cout << std::endl;
+	}
+
+	fs.shutdown();
+	return result.rejected > 0 ? 2 : 0;
+}
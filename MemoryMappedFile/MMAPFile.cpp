@@ -42,7 +42,7 @@ bool fileExists(const char* fname) {
 /*
  * Constructor!
  */
-STORAGE::DynamicMemoryMappedFile::DynamicMemoryMappedFile(const char* fname) : backingFilename(fname) {
+STORAGE::DynamicMemoryMappedFile::DynamicMemoryMappedFile(const char* fname) : backingFilename(fname), views(0) {
 	// If the backing file does not exist, we need to create it
 	bool createInitial;
 
@@ -139,8 +139,6 @@ int STORAGE::DynamicMemoryMappedFile::shutdown(const int code) {
 	return code;
 }
 
-const size_t MaxFileSize = 1 << 30; // No file can be more than a GB
-
 #include <cassert>
 
 int STORAGE::DynamicMemoryMappedFile::raw_write(const char *data, size_t len, size_t pos) {
@@ -193,6 +191,62 @@ char *STORAGE::DynamicMemoryMappedFile::raw_read(size_t pos, size_t len, size_t
 	return data;
 }
 
+int STORAGE::DynamicMemoryMappedFile::raw_read_into(char *data, size_t pos, size_t len, size_t off) {
+	size_t start = pos + off;
+	size_t end = start + len;
+
+	if (end > mapSize) {
+		// Crash gently...
+		logEvent(ERROR, "Attempted to read beyond the end of the filesystem!");
+		shutdown(FAILURE);
+	}
+
+	{
+		std::unique_lock<std::mutex> lk(growthLock);
+		memcpy(data, fs + start, len);
+	}
+
+	return 0;
+}
+
+int STORAGE::DynamicMemoryMappedFile::raw_view(size_t pos, size_t len, const std::function<void(const char *)> &fn, size_t off) {
+	size_t start = pos + off;
+	size_t end = start + len;
+
+	// The callback runs without the lock, only counting as a view so that the mapping it reads stays in place
+	const char *data;
+	{
+		std::unique_lock<std::mutex> lk(growthLock);
+		if (end > mapSize) {
+			// Crash gently...
+			logEvent(ERROR, "Attempted to read beyond the end of the filesystem!");
+			shutdown(FAILURE);
+		}
+		views++;
+		data = fs + start;
+	}
+	struct Release {
+		DynamicMemoryMappedFile *file;
+		~Release() { file->releaseView(); }
+	} release = { this };
+	fn(data);
+
+	return 0;
+}
+
+int STORAGE::DynamicMemoryMappedFile::reserve(size_t len) {
+	size_t end = len + HEADER_SIZE;
+
+	{
+		std::unique_lock<std::mutex> lk(growthLock);
+		if (end > mapSize) {
+			grow(end, 1.0);
+		}
+	}
+
+	return 0;
+}
+
 /*
  * Private Methods
  */
@@ -243,13 +297,13 @@ size_t STORAGE::DynamicMemoryMappedFile::align(size_t amt) {
 	return amt + alignment - rem;
 }
 
-void STORAGE::DynamicMemoryMappedFile::grow(size_t newSize) {	// Increase the size by some amount
+void STORAGE::DynamicMemoryMappedFile::grow(size_t newSize, double factor) {	// Increase the size by some amount
 	size_t oldMapSize = mapSize;
 	size_t amt = newSize - oldMapSize;
 	if (amt <= 0) {
 		return;
 	}
-	size_t test = (size_t)std::ceil(newSize * GROWTH_FACTOR);
+	size_t test = (size_t)std::ceil(newSize * factor);
 	mapSize = align(test > maxSize ? maxSize : test);
 
 #if EXTRATESTING
@@ -259,7 +313,11 @@ void STORAGE::DynamicMemoryMappedFile::grow(size_t newSize) {	// Increase the si
 	SetFilePointer(fHandle, mapSize, NULL, FILE_BEGIN);
 	SetEndOfFile(fHandle);
 	SetFilePointer(fHandle, 0, NULL, FILE_BEGIN);
-	munmap(fs, mapSize);
+	if (views > 0) {
+		retired.push_back(std::make_pair(fs, oldMapSize));
+	} else {
+		munmap(fs, oldMapSize);
+	}
 	fs = (char*)mmap((void*)NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED,fd, 0);
 	
 	if (fs == MAP_FAILED) {
@@ -268,3 +326,14 @@ void STORAGE::DynamicMemoryMappedFile::grow(size_t newSize) {	// Increase the si
 		shutdown(FAILURE);
 	}
 }
+
+// Unmap the mappings that grow replaced once no view can still be reading them
+void STORAGE::DynamicMemoryMappedFile::releaseView() {
+	std::unique_lock<std::mutex> lk(growthLock);
+	if (--views == 0) {
+		for (auto &mapping : retired) {
+			munmap(mapping.first, mapping.second);
+		}
+		retired.clear();
+	}
+}
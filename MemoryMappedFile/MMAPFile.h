@@ -38,6 +38,9 @@ int ftruncate(int, size_t);
 #include <cstring>
 #include <mutex>
 #include <atomic>
+#include <functional>
+#include <utility>
+#include <vector>
 
 #define GROWTH_FACTOR 1.05 // Grow 5% larger than requested.  This helps to prevent excessive calls to grow
 static short VERSION = 1;
@@ -47,6 +50,9 @@ static char SANITY[] = { 0x0,0x0,0xd,0x1,0xe,0x5,0x0,0xf,0xd,0x0,0x0,0xd,0xa,0xd
 // Limit the overall size of the file to 4GB for compatibility reasons
 static const size_t maxSize = (size_t)(std::pow(2, 32) - 1);
 
+// No single read or write can be more than a GB
+static const size_t MaxFileSize = 1 << 30;
+
 // Test for file existence
 bool fileExists(const char*);
 
@@ -74,6 +80,24 @@ namespace STORAGE {
 		 */
 		MMAPFILEDLL_API char *raw_read(size_t, size_t, size_t = HEADER_SIZE);
 
+		/*
+		 * Read raw data from the filesystem into a caller provided buffer.
+		 */
+		MMAPFILEDLL_API int raw_read_into(char *, size_t, size_t, size_t = HEADER_SIZE);
+
+		/*
+		 * Hand a read only pointer to raw data in the map to a callback.  Views run side by side and do not hold up
+		 * reads or writes, and the callback may use the file itself: if a write grows the map meanwhile, the old
+		 * mapping stays in place until the last view is over.
+		 */
+		MMAPFILEDLL_API int raw_view(size_t, size_t, const std::function<void(const char *)> &, size_t = HEADER_SIZE);
+
+		/*
+		 * Grow the map once, to exactly the size needed for the given number of bytes of data, so that writes up
+		 * to that size never have to grow it.
+		 */
+		MMAPFILEDLL_API int reserve(size_t);
+
 		/*
 		 * The file is new until it is written to for the first time
 		 */
@@ -91,6 +115,8 @@ namespace STORAGE {
 		int numPages;
 		size_t mapSize;
 		std::mutex growthLock;
+		size_t views;									// Callbacks running in raw_view, guarded by growthLock
+		std::vector<std::pair<char *, size_t>> retired;	// Mappings replaced by grow while views were running
 		HANDLE fHandle;
 		intptr_t fd;
 
@@ -101,7 +127,8 @@ namespace STORAGE {
 		void writeHeader();
 		char *readHeader();
 		bool sanityCheck(const char*);
-		void grow(size_t);
+		void grow(size_t, double = GROWTH_FACTOR);
+		void releaseView();
 		size_t align(size_t);
 	};
 }
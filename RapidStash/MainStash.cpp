@@ -11,24 +11,23 @@
 
 void performance(std::string& msg) {
 	const int iterations = 100000;
-	char* herp = new char[1024*1024];
-	char* endptr = nullptr;
+	const char* endptr = nullptr;
 
 	JsonAllocator allocator;
 
 	std::cout << "Parsing: " << msg << std::endl;
 	auto start = std::chrono::high_resolution_clock::now();
 	for (int i = 0; i < iterations; ++i) {
-		memcpy(herp, msg.c_str(), msg.length() + 1);
 		JsonValue value;
 
-		int status = jsonParse(herp, &endptr, &value, allocator);
+		// The view parser leaves the input alone, so there is no need to copy it first
+		int status = jsonParseView(msg.c_str(), msg.length(), &endptr, &value, allocator);
 		if (status != JSON_OK) {
 			std::cout << "Failure?" << std::endl;
 		}
-		allocator.deallocate();
+		// Keeps the zones, so after the first iteration parsing does not allocate
+		allocator.reset();
 	}
-	delete herp;
 	auto end = std::chrono::high_resolution_clock::now();
 
 	std::cout << iterations  / (0.000001 + std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count())<< " iterations per millisecond" << std::endl;
@@ -36,29 +35,21 @@ void performance(std::string& msg) {
 
 void fileSystemPerformance(STORAGE::Filesystem* fs, std::string filename, std::string should) {
 	const int iterations = 100000;
-	char* herp = new char[1024 * 1024];
-	char* endptr = nullptr;
-
-	JsonAllocator allocator;
-
 
 	std::cout << "Parsing: " << should << std::endl;
 	auto start = std::chrono::high_resolution_clock::now();
 	for (int i = 0; i < iterations; ++i) {
-		File file = fs->select(filename);
-		STORAGE::IO::Reader reader = fs->getReader(file);
-		std::string msg = reader.readString();
+		File file = fs->find(filename);
+		STORAGE::IO::DocumentReader reader = fs->getDocumentReader(file);
 
-		memcpy(herp, msg.c_str(), msg.length() + 1);
-		JsonValue value;
-
-		int status = jsonParse(herp, &endptr, &value, allocator);
-		if (status != JSON_OK) {
+		// Parsed straight out of the memory map, without copying the file
+		try {
+			reader.view([](JsonValue) {});
+		}
+		catch (STORAGE::IO::BadDocumentException &) {
 			std::cout << "Failure?" << std::endl;
 		}
-		allocator.deallocate();
 	}
-	delete herp;
 	auto end = std::chrono::high_resolution_clock::now();
 
 	std::cout << iterations / (0.0000000001 + std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()) << " iterations per millisecond" << std::endl;
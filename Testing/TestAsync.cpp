@@ -0,0 +1,47 @@
+#include "Filesystem.h"
+#include "Testing.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Queue writes and reads on several files and verify each read sees the write queued before it
+int TestAsync(STORAGE::Filesystem *fs) {
+	std::vector<std::future<File>> files;
+	for (int i = 0; i < numNames; ++i) {
+		files.push_back(fs->selectAsync("TestFile" + toString(i)));
+	}
+
+	std::vector<std::string> data;
+	std::vector<std::future<void>> writes;
+	std::vector<std::future<std::string>> reads;
+	for (int i = 0; i < numNames; ++i) {
+		File f = files[i].get();
+		data.push_back(random_string(dataSize));
+		writes.push_back(fs->writeAsync(f, random_string(dataSize)));
+		writes.push_back(fs->writeAsync(f, data[i]));
+		reads.push_back(fs->readAsync(f));
+	}
+
+	for (auto &w : writes) {
+		w.get();
+	}
+	for (int i = 0; i < numNames; ++i) {
+		if (reads[i].get().compare(data[i]) != 0) {
+			return -1;
+		}
+	}
+
+	// IO submitted after shutdown is refused up front
+	{
+		STORAGE::Filesystem stopped("data/Async Stopped");
+		File f = stopped.select("TestFile");
+		stopped.shutdown();
+		try {
+			stopped.writeAsync(f, data[0]);
+			return -1;
+		} catch (std::runtime_error &) {}
+	}
+
+	return 0;
+}
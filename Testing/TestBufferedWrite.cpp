@@ -0,0 +1,52 @@
+#include "Filewriter.h"
+#include "Filesystem.h"
+#include "Testing.h"
+
+#include <string>
+
+static const int numRecords = 1024;
+static const int recordSize = 24;
+
+// Write many small records through a buffered writer and verify they are coalesced and land in order
+int TestBufferedWrite(STORAGE::Filesystem *fs) {
+	File &file = fs->select("TestFile");
+	std::string expected;
+	size_t writes = fs->count(STORAGE::NUMWRITES);
+	{
+		STORAGE::IO::BufferedWriter writer = fs->getBufferedWriter(file, 1024);
+		for (int i = 0; i < numRecords; ++i) {
+			std::string record = random_string(recordSize);
+			writer.write(record.c_str(), record.size());
+			expected += record;
+		}
+		if (writer.pending() >= 1024) {
+			return -1;
+		}
+	} // The remainder is flushed here
+	if (fs->count(STORAGE::NUMWRITES) - writes != (numRecords * recordSize + 1023) / 1024) {
+		return -1;
+	}
+
+	STORAGE::IO::SafeReader reader = fs->getSafeReader(file);
+	std::string res = reader.readString();
+	if (res.compare(expected) != 0) {
+		return -1;
+	}
+
+	// A write at the threshold with nothing buffered goes straight through
+	File &large = fs->select("TestLarge");
+	std::string record = random_string(1024);
+	writes = fs->count(STORAGE::NUMWRITES);
+	{
+		STORAGE::IO::BufferedWriter writer = fs->getBufferedWriter(large, 1024);
+		writer.write(record.c_str(), record.size());
+		if (writer.pending() != 0 || fs->count(STORAGE::NUMWRITES) - writes != 1) {
+			return -1;
+		}
+	}
+	if (fs->count(STORAGE::NUMWRITES) - writes != 1 || fs->getSafeReader(large).readString() != record) {
+		return -1;
+	}
+
+	return 0;
+}
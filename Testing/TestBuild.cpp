@@ -0,0 +1,79 @@
+#include "Filesystem.h"
+#include "Testing.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Build a store out of order, replacing a value on the way, and open it as any other store
+int TestBuild(STORAGE::Filesystem *) {
+	const int numFiles = 1000;
+	const std::string path = "data/Build Output";
+
+	STORAGE::IO::StoreBuilder builder;
+	std::vector<std::string> values(numFiles);
+	for (int i = numFiles - 1; i >= 0; --i) {
+		values[i] = toString(i) + random_string(i % 100);
+		builder.add("TestBuild" + toString(i), values[i].c_str(), values[i].size());
+	}
+	values[5] = "replaced";
+	builder.add("TestBuild5", values[5].c_str(), values[5].size());
+
+	char json[] = "{\"a\" : [1, 2]}";
+	char *endptr;
+	JsonValue value;
+	JsonAllocator allocator;
+	if (jsonParse(json, &endptr, &value, allocator) != JSON_OK) {
+		return -1;
+	}
+	builder.add("TestBuildDocument", value);
+
+	try {
+		builder.add(std::string(STORAGE::FileHeader::MAXNAMELEN, 'x'), "", 0);
+		return -1;
+	} catch (std::invalid_argument &) {}
+	if (builder.count() != numFiles + 1) {
+		return -1;
+	}
+
+	// The store being tested already has a backing file
+	try {
+		builder.build("data/Build");
+		return -1;
+	} catch (std::invalid_argument &) {}
+	builder.build(path.c_str());
+	if (builder.count() != 0) {
+		return -1;
+	}
+
+	STORAGE::Filesystem built(path.c_str());
+	if (built.count(STORAGE::FILES) != numFiles + 1) {
+		built.shutdown();
+		return -1;
+	}
+	for (int i = 0; i < numFiles; ++i) {
+		File f = built.find("TestBuild" + toString(i));
+		if (f == STORAGE::NOFILE || built.getHeader(f).version != 0 || built.getReader(f).readString() != values[i]) {
+			built.shutdown();
+			return -1;
+		}
+	}
+	STORAGE::IO::Document document = built.getDocumentReader(built.find("TestBuildDocument")).read();
+	JsonNode *a = document.find(document.root(), "a");
+	if (!document.isTape() || a == nullptr || a->value.getTag() != JSON_ARRAY) {
+		built.shutdown();
+		return -1;
+	}
+
+	// Files can be written after the store is built
+	built.put("TestBuild5", "rewritten", 9);
+	built.put("TestBuildNew", "new", 3);
+	std::string out;
+	if (!built.tryGet("TestBuild5", out) || out != "rewritten" || !built.tryGet("TestBuildNew", out) || out != "new") {
+		built.shutdown();
+		return -1;
+	}
+
+	built.shutdown();
+	return 0;
+}
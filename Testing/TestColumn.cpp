@@ -0,0 +1,87 @@
+#include "Filesystem.h"
+#include "Testing.h"
+
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// Aggregate a field across documents, then check that writes, in place and not, are picked up by the cache
+int TestColumn(STORAGE::Filesystem *fs) {
+	const int numDocuments = 1000;
+	const char *groups[] = { "red", "green", "blue" };
+
+	for (int i = 0; i < numDocuments; ++i) {
+		std::ostringstream json;
+		json << "{\"group\" : \"" << groups[i % 3] << "\"";
+		if (i % 10 != 0) {
+			json << ", \"stats\" : {\"score\" : " << i << "}";	// Every tenth document has no score
+		}
+		json << "}";
+		File f = fs->select("TestColumn" + toString(i));
+		if (i % 2 == 0) {
+			STORAGE::IO::DocumentWriter writer = fs->getDocumentWriter(f);
+			writer.write(json.str().c_str(), json.str().size());
+		} else {
+			STORAGE::IO::Writer writer = fs->getWriter(f);
+			writer.write(json.str().c_str(), json.str().size());
+		}
+	}
+	fs->select("TestColumnEmpty");	// Never written
+
+	try {
+		fs->aggregate("stats.score");
+		return -1;
+	} catch (std::invalid_argument &) {}
+
+	fs->registerColumn("stats.score");
+	fs->registerColumn("group", STORAGE::IO::KEYS);
+
+	// Sums of whole numbers are exact, whatever order they are added in
+	double sum = 0;
+	std::map<std::string, double> sums;
+	for (int i = 0; i < numDocuments; ++i) {
+		if (i % 10 != 0) {
+			sum += i;
+			sums[groups[i % 3]] += i;
+		}
+	}
+	STORAGE::IO::Aggregate all = fs->aggregate("stats.score");
+	if (all.count != numDocuments - numDocuments / 10 || all.sum != sum || all.min != 1 || all.max != numDocuments - 1) {
+		return -1;
+	}
+	std::map<std::string, STORAGE::IO::Aggregate> byGroup = fs->aggregate("stats.score", "group");
+	if (byGroup.size() != 3) {
+		return -1;
+	}
+	for (auto &group : byGroup) {
+		if (group.second.sum != sums[group.first]) {
+			return -1;
+		}
+	}
+
+	// A write in place (same size, so it is not moved) and a write that moves the file
+	File f = fs->find("TestColumn1");
+	{
+		STORAGE::IO::Writer writer = fs->getWriter(f);
+		writer.write("{\"group\":\"blue\",\"stats\":{\"score\":9}}", 36);
+	}
+	f = fs->find("TestColumn998");
+	{
+		STORAGE::IO::DocumentWriter writer = fs->getDocumentWriter(f);
+		const char *json = "{\"group\" : \"other\", \"stats\" : {\"score\" : -5, \"padding\" : \"makes it larger\"}}";
+		writer.write(json, strlen(json));
+	}
+	all = fs->aggregate("stats.score");
+	if (all.count != numDocuments - numDocuments / 10 || all.sum != sum - 1 + 9 - 998 - 5 || all.min != -5 || all.max != numDocuments - 1) {
+		return -1;
+	}
+	byGroup = fs->aggregate("stats.score", "group");
+	if (byGroup.size() != 4 || byGroup["other"].count != 1 || byGroup["blue"].sum != sums["blue"] + 9 - 998 ||
+		byGroup["green"].sum != sums["green"] - 1 || byGroup["red"].sum != sums["red"]) {
+		return -1;
+	}
+
+	return 0;
+}
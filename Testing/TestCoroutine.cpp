@@ -0,0 +1,88 @@
+#include "Filesystem.h"
+#include "Testing.h"
+
+#include <atomic>
+#include <future>
+#include <string>
+#include <vector>
+
+#ifdef RAPIDSTASH_COROUTINES
+static STORAGE::IO::Async<bool> roundTrip(STORAGE::Filesystem *fs, std::string name, std::string data) {
+	co_await fs->write(name, data);
+	std::string back = co_await fs->read(name);
+	co_return back.compare(data) == 0;
+}
+
+static STORAGE::IO::Async<bool> driver(STORAGE::Filesystem *fs, std::string name, std::string data) {
+	co_await fs->schedule();
+	co_return co_await roundTrip(fs, name, data);
+}
+#endif
+
+// Callbacks and coroutines waiting on a held lock are started by the unlock instead of blocking a thread
+int TestCoroutine(STORAGE::Filesystem *fs) {
+	const int numWaiters = 100;
+	File f = fs->select("TestFile");
+	std::string data = random_string(dataSize);
+	{
+		STORAGE::IO::Writer writer = fs->getWriter(f);
+		fs->lock(f, STORAGE::IO::EXCLUSIVE);
+		writer.write(data.c_str(), data.size());
+		fs->unlock(f, STORAGE::IO::EXCLUSIVE);
+	}
+
+	fs->lock(f, STORAGE::IO::EXCLUSIVE);
+	std::atomic<int> granted(0);
+	std::vector<std::promise<void>> done(numWaiters);
+	for (int i = 0; i < numWaiters; ++i) {
+		STORAGE::IO::LockType type = i % 10 == 0 ? STORAGE::IO::EXCLUSIVE : STORAGE::IO::SHARED;
+		std::promise<void> *p = &done[i];
+		fs->lockAsync(f, type, [fs, f, type, p, &granted] {
+			granted++;
+			fs->unlock(f, type);
+			p->set_value();
+		});
+	}
+	if (granted != 0) {
+		fs->unlock(f, STORAGE::IO::EXCLUSIVE);
+		return -1;
+	}
+	fs->unlock(f, STORAGE::IO::EXCLUSIVE);
+	for (auto &p : done) {
+		p.get_future().wait();
+	}
+	if (granted != numWaiters) {
+		return -1;
+	}
+
+	// Waiters granted after shutdown are run by the unlock itself
+	{
+		STORAGE::Filesystem stopped("data/Coroutine Stopped");
+		File g = stopped.select("TestFile");
+		bool ran = false;
+		stopped.lock(g, STORAGE::IO::EXCLUSIVE);
+		stopped.lockAsync(g, STORAGE::IO::SHARED, [&stopped, g, &ran] {
+			ran = true;
+			stopped.unlock(g, STORAGE::IO::SHARED);
+		});
+		stopped.shutdown();
+		stopped.unlock(g, STORAGE::IO::EXCLUSIVE);
+		if (!ran) {
+			return -1;
+		}
+	}
+
+#ifdef RAPIDSTASH_COROUTINES
+	std::vector<STORAGE::IO::Async<bool>> tasks;
+	for (int i = 0; i < numWaiters; ++i) {
+		tasks.push_back(driver(fs, "TestFile" + toString(i % 4), random_string(dataSize)));
+	}
+	for (auto &task : tasks) {
+		if (!task.get()) {
+			return -1;
+		}
+	}
+#endif
+
+	return 0;
+}
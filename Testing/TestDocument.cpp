@@ -0,0 +1,291 @@
+#include "Filedocument.h"
+#include "Filesystem.h"
+#include "Testing.h"
+
+#include <string>
+
+static const std::string json = "{\"name\" : \"rapid\\nstash\", \"count\" : 42, \"tags\" : [\"a\", \"b\", true, null], \"nested\" : {\"pi\" : 3.5}}";
+
+// Strings parsed from a view are slices rather than C strings
+static bool isString(JsonValue value, const std::string &expected) {
+	if (value.getTag() == JSON_SLICE) {
+		return std::string(value.toSlice()->data, value.toSlice()->length) == expected;
+	}
+	return value.getTag() == JSON_STRING && value.toString() == expected;
+}
+
+// Check the decoded form of the document above
+static bool matches(JsonValue root) {
+	if (root.getTag() != JSON_OBJECT) {
+		return false;
+	}
+	int seen = 0;
+	for (auto member : root) {
+		std::string key = member->key;
+		JsonValue value = member->value;
+		if (key == "name") {
+			seen += isString(value, "rapid\nstash");
+		} else if (key == "count") {
+			seen += value.getTag() == JSON_NUMBER && value.toNumber() == 42;
+		} else if (key == "tags") {
+			int n = 0;
+			for (auto element : value) {
+				n += (n < 2 && isString(element->value, n == 0 ? "a" : "b")) || (n == 2 && element->value.getTag() == JSON_TRUE) ||
+					(n == 3 && element->value.getTag() == JSON_NULL);
+			}
+			seen += n == 4;
+		} else if (key == "nested") {
+			for (auto inner : value) {
+				seen += std::string(inner->key) == "pi" && inner->value.toNumber() == 3.5;
+			}
+		}
+	}
+	return seen == 4;
+}
+
+// Write JSON as a document and read it back, with plain JSON files and invalid JSON alongside
+int TestDocument(STORAGE::Filesystem *fs) {
+	File file = fs->select("TestDocument");
+	fs->lock(file, STORAGE::IO::EXCLUSIVE);
+	{
+		STORAGE::IO::DocumentWriter writer = fs->getDocumentWriter(file);
+		writer.write(json.c_str(), json.size());
+	}
+	fs->unlock(file, STORAGE::IO::EXCLUSIVE);
+
+	fs->lock(file, STORAGE::IO::SHARED);
+	STORAGE::IO::Document document = fs->getDocumentReader(file).read();
+	fs->unlock(file, STORAGE::IO::SHARED);
+	if (!document.isTape() || !matches(document.root())) {
+		return -1;
+	}
+
+	// Rewriting the file must not disturb a document that has already been read
+	fs->lock(file, STORAGE::IO::EXCLUSIVE);
+	{
+		STORAGE::IO::DocumentWriter writer = fs->getDocumentWriter(file);
+		writer.write("[1, 2, 3]", 9);
+	}
+	fs->unlock(file, STORAGE::IO::EXCLUSIVE);
+	if (!matches(document.root())) {
+		return -1;
+	}
+
+	// Files holding JSON text are parsed instead of decoded
+	File text = fs->select("TestDocumentText");
+	fs->lock(text, STORAGE::IO::EXCLUSIVE);
+	{
+		STORAGE::IO::Writer writer = fs->getWriter(text);
+		writer.write(json.c_str(), json.size());
+	}
+	fs->unlock(text, STORAGE::IO::EXCLUSIVE);
+
+	fs->lock(text, STORAGE::IO::SHARED);
+	STORAGE::IO::Document parsed = fs->getDocumentReader(text).read();
+	fs->unlock(text, STORAGE::IO::SHARED);
+	if (parsed.isTape() || !matches(parsed.root())) {
+		return -1;
+	}
+
+	// Views parse straight out of the map, from text and from tapes alike, without writing to it
+	int viewed = 0;
+	fs->lock(text, STORAGE::IO::SHARED);
+	fs->getDocumentReader(text).view([&](JsonValue root) { viewed += matches(root); });
+	fs->unlock(text, STORAGE::IO::SHARED);
+	fs->lock(file, STORAGE::IO::SHARED);
+	fs->getDocumentReader(file).view([&](JsonValue root) { viewed += root.getTag() == JSON_ARRAY; });
+	fs->unlock(file, STORAGE::IO::SHARED);
+	if (viewed != 2 || fs->getReader(text).readString(json.size()) != json) {
+		return -1;
+	}
+
+	// A view may use the filesystem, even to write enough to grow the map out from under it
+	std::string grown(1 << 19, 'g');
+	fs->lock(text, STORAGE::IO::SHARED);
+	fs->getDocumentReader(text).view([&](JsonValue root) {
+		fs->put("TestDocumentGrow", grown.c_str(), grown.size());
+		File f = fs->find("TestDocumentGrow");
+		viewed += fs->getReader(f).readString(grown.size()) == grown && matches(root);
+	});
+	fs->unlock(text, STORAGE::IO::SHARED);
+	fs->unlink(fs->find("TestDocumentGrow"));
+	if (viewed != 3) {
+		return -1;
+	}
+
+	// Cursors pull single fields out of text and tapes without decoding the rest
+	File cursorFile = fs->select("TestDocumentCursor");
+	fs->lock(cursorFile, STORAGE::IO::EXCLUSIVE);
+	{
+		STORAGE::IO::DocumentWriter writer = fs->getDocumentWriter(cursorFile);
+		writer.write(json.c_str(), json.size());
+	}
+	fs->unlock(cursorFile, STORAGE::IO::EXCLUSIVE);
+	int found = 0;
+	for (File f : {text, cursorFile}) {
+		fs->lock(f, STORAGE::IO::SHARED);
+		fs->getDocumentReader(f).cursor([&](JsonCursor document) {
+			JsonCursor field;
+			JsonValue value;
+			JsonAllocator allocator;
+			found += document.find("nested.pi", &field) == JSON_OK && field.parse(&value, allocator) == JSON_OK && value.toNumber() == 3.5;
+			found += document.find("tags[1]", &field) == JSON_OK && field.parse(&value, allocator) == JSON_OK && isString(value, "b");
+			found += document.find("tags[4]", &field) == JSON_NOT_FOUND && document.find("name.first", &field) == JSON_NOT_FOUND;
+		});
+		fs->unlock(f, STORAGE::IO::SHARED);
+	}
+	if (found != 6) {
+		return -1;
+	}
+
+	// Integers beyond 2^53 survive the tape exactly
+	fs->lock(cursorFile, STORAGE::IO::EXCLUSIVE);
+	{
+		STORAGE::IO::DocumentWriter writer = fs->getDocumentWriter(cursorFile);
+		writer.write("{\"id\" : 9007199254740993}", 25);
+	}
+	fs->unlock(cursorFile, STORAGE::IO::EXCLUSIVE);
+	fs->lock(cursorFile, STORAGE::IO::SHARED);
+	STORAGE::IO::Document large = fs->getDocumentReader(cursorFile).read();
+	fs->unlock(cursorFile, STORAGE::IO::SHARED);
+	JsonValue id = large.root().toNode()->value;
+	if (id.getTag() != JSON_INTEGER || id.toInteger() != 9007199254740993LL) {
+		return -1;
+	}
+
+	// Members of wide objects are found through the index, the first of duplicate keys winning
+	std::string wide = "{";
+	for (int i = 0; i < 40; ++i) {
+		wide += "\"key" + std::to_string(i) + "\" : " + std::to_string(i) + ", ";
+	}
+	wide += "\"key7\" : -1}";
+	fs->lock(cursorFile, STORAGE::IO::EXCLUSIVE);
+	{
+		STORAGE::IO::DocumentWriter writer = fs->getDocumentWriter(cursorFile);
+		writer.write(wide.c_str(), wide.size());
+	}
+	fs->unlock(cursorFile, STORAGE::IO::EXCLUSIVE);
+	fs->lock(cursorFile, STORAGE::IO::SHARED);
+	STORAGE::IO::Document indexed = fs->getDocumentReader(cursorFile).read();
+	fs->unlock(cursorFile, STORAGE::IO::SHARED);
+	for (int i = 0; i < 40; ++i) {
+		JsonNode *node = indexed.find(indexed.root(), ("key" + std::to_string(i)).c_str());
+		if (node == nullptr || node->value.toNumber() != i) {
+			return -1;
+		}
+	}
+	if (indexed.find(indexed.root(), "key40") != nullptr) {
+		return -1;
+	}
+
+	// Nesting deeper than the parser's on-stack levels is stored and read back
+	std::string deep = std::string(100, '[') + "1" + std::string(100, ']');
+	fs->lock(cursorFile, STORAGE::IO::EXCLUSIVE);
+	{
+		STORAGE::IO::DocumentWriter writer = fs->getDocumentWriter(cursorFile);
+		writer.write(deep.c_str(), deep.size());
+	}
+	fs->unlock(cursorFile, STORAGE::IO::EXCLUSIVE);
+	fs->lock(cursorFile, STORAGE::IO::SHARED);
+	STORAGE::IO::Document nested = fs->getDocumentReader(cursorFile).read();
+	fs->unlock(cursorFile, STORAGE::IO::SHARED);
+	JsonValue inner = nested.root();
+	for (int i = 0; i < 100; ++i) {
+		if (inner.getTag() != JSON_ARRAY) {
+			return -1;
+		}
+		inner = inner.toNode()->value;
+	}
+	if (inner.toNumber() != 1) {
+		return -1;
+	}
+
+	// Values written back as text read back the same, string escapes and exact integers included
+	File textOut = fs->select("TestDocumentJson");
+	fs->lock(textOut, STORAGE::IO::EXCLUSIVE);
+	{
+		STORAGE::IO::Writer writer = fs->getWriter(textOut);
+		STORAGE::IO::writeJson(writer, document.root());
+	}
+	fs->unlock(textOut, STORAGE::IO::EXCLUSIVE);
+	fs->lock(textOut, STORAGE::IO::SHARED);
+	STORAGE::IO::Document rewritten = fs->getDocumentReader(textOut).read();
+	fs->unlock(textOut, STORAGE::IO::SHARED);
+	if (rewritten.isTape() || !matches(rewritten.root())) {
+		return -1;
+	}
+	{
+		STORAGE::IO::SafeWriter writer = fs->getSafeWriter(textOut);
+		STORAGE::IO::writeJson(writer, large.root());
+	}
+	if (fs->getReader(textOut).readString(fs->getHeader(textOut).size) != "{\"id\":9007199254740993}") {
+		return -1;
+	}
+
+	// Patches only touch the members they name, tapes and text alike, and edits that keep their size leave the
+	// file where it is
+	File patched = fs->select("TestDocumentPatch");
+	const std::string patch = "{\"count\" : 7, \"tags\" : null, \"nested\" : {\"e\" : 2.5}, \"added\" : [true]}";
+	fs->lock(patched, STORAGE::IO::EXCLUSIVE);
+	{
+		STORAGE::IO::DocumentWriter writer = fs->getDocumentWriter(patched);
+		writer.write(json.c_str(), json.size());
+		writer.patch(patch.c_str(), patch.size());
+	}
+	fs->unlock(patched, STORAGE::IO::EXCLUSIVE);
+	STORAGE::IO::Document merged = fs->getDocumentReader(patched).read();
+	JsonNode *member = merged.find(merged.root(), "nested");
+	if (!merged.isTape() || merged.find(merged.root(), "tags") != nullptr || merged.find(merged.root(), "count")->value.toNumber() != 7 ||
+		member == nullptr || merged.find(member->value, "pi") == nullptr || merged.find(member->value, "e")->value.toNumber() != 2.5 ||
+		merged.find(merged.root(), "added")->value.toNode()->value.getTag() != JSON_TRUE) {
+		return -1;
+	}
+	FileSize patchedSize = fs->getHeader(patched).size;
+	fs->lock(patched, STORAGE::IO::EXCLUSIVE);
+	fs->getDocumentWriter(patched).set("nested.pi", JsonValue(4.0));
+	fs->unlock(patched, STORAGE::IO::EXCLUSIVE);
+	STORAGE::IO::Document set = fs->getDocumentReader(patched).read();
+	member = set.find(set.root(), "nested");
+	if (fs->getHeader(patched).size != patchedSize || set.find(member->value, "pi")->value.toNumber() != 4.0) {
+		return -1;
+	}
+	fs->lock(textOut, STORAGE::IO::EXCLUSIVE);
+	fs->getDocumentWriter(textOut).patch("{\"id\" : 1}", 10);
+	fs->unlock(textOut, STORAGE::IO::EXCLUSIVE);
+	if (fs->getReader(textOut).readString(fs->getHeader(textOut).size) != "{\"id\":1               }") {
+		return -1;
+	}
+
+	// Allocators go back to the thread's pool and are handed out again, zones and all
+	JsonAllocator *borrowed;
+	{
+		STORAGE::IO::PooledAllocator allocator;
+		borrowed = &*allocator;
+		if (allocator->allocate(100000) == nullptr) {
+			return -1;
+		}
+	}
+	{
+		STORAGE::IO::PooledAllocator allocator;
+		if (&*allocator != borrowed) {
+			return -1;
+		}
+	}
+
+	// Invalid JSON is rejected without touching the file
+	bool thrown = false;
+	fs->lock(text, STORAGE::IO::EXCLUSIVE);
+	try {
+		STORAGE::IO::DocumentWriter writer = fs->getDocumentWriter(text);
+		writer.write("{\"a\" : ", 7);
+	}
+	catch (STORAGE::IO::BadDocumentException &) {
+		thrown = true;
+	}
+	fs->unlock(text, STORAGE::IO::EXCLUSIVE);
+	if (!thrown || fs->getHeader(text).size != json.size()) {
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,24 @@
+#include "Filesystem.h"
+#include "Testing.h"
+
+#include <string>
+
+// Lookups of missing files must not create them, and a put creates the file on its first write
+int TestFind(STORAGE::Filesystem *fs) {
+	size_t before = fs->count(STORAGE::FILES);
+	std::string res;
+	if (fs->find("TestFile") != STORAGE::NOFILE || fs->tryGet("TestFile", res) ||
+		fs->count(STORAGE::FILES) != before) {
+		return -1;
+	}
+
+	std::string data = random_string(dataSize);
+	fs->put("TestFile", data.c_str(), data.size());
+	File f = fs->find("TestFile");
+	if (f == STORAGE::NOFILE || !fs->tryGet("TestFile", res) || res.compare(data) != 0 ||
+		fs->count(STORAGE::FILES) != before + 1) {
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,42 @@
+#include "Filesystem.h"
+#include "Testing.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+
+// A parallel scan visits every file exactly once and sees its current contents
+int TestForEach(STORAGE::Filesystem *fs) {
+	const int numFiles = 100;
+	std::map<std::string, std::string> expected;
+	for (int i = 0; i < numFiles; ++i) {
+		std::string name = "TestFile" + toString(i);
+		std::string data = random_string(dataSize + i);
+		fs->put(name, data.c_str(), data.size());
+		expected[name] = data;
+	}
+
+	std::mutex m;
+	std::map<std::string, int> seen;
+	std::atomic<int> mismatches(0);
+	size_t visited = fs->parallelForEach([&](File, const std::string &name, const char *data, FileSize size) {
+		// Only read from the pool threads, and a file that was never put is a mismatch
+		auto it = expected.find(name);
+		if (it == expected.end() || it->second.compare(0, std::string::npos, data, size) != 0) {
+			mismatches++;
+		}
+		std::lock_guard<std::mutex> lk(m);
+		seen[name]++;
+	});
+
+	if (visited != fs->count(STORAGE::FILES) || mismatches != 0 || seen.size() != numFiles) {
+		return -1;
+	}
+	for (auto &entry : seen) {
+		if (entry.second != 1) {
+			return -1;
+		}
+	}
+	return 0;
+}
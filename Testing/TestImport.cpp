@@ -0,0 +1,78 @@
+#include "Filesystem.h"
+#include "Testing.h"
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+// Import documents named by a key, in small chunks so that lines straddle reads, then import by line number
+int TestImport(STORAGE::Filesystem *fs) {
+	const int numDocuments = 2000;
+
+	File existing = fs->select("TestImport7");
+	{
+		STORAGE::IO::SafeWriter writer = fs->getSafeWriter(existing);
+		writer.write("old", 3);
+	}
+
+	std::ostringstream ndjson;
+	for (int i = 0; i < numDocuments; ++i) {
+		ndjson << "{\"id\" : " << i << ", \"padding\" : \"" << random_string(i % 50) << "\"}\n";
+		if (i == 10) {
+			ndjson << "{\"id\" : \n\n  \r\n";	// Rejected, then two blank lines
+		}
+	}
+	ndjson << "{\"id\" : 7, \"padding\" : \"" << std::string(10000, 'x') << "\"}\r\n";	// Replaces the first 7
+	ndjson << "{\"name\" : \"no id\"}";													// Rejected, and unterminated
+
+	STORAGE::IO::ImportOptions options;
+	options.keyPath = "id";
+	options.prefix = "TestImport";
+	options.chunkSize = 4096;
+	std::istringstream in(ndjson.str());
+	STORAGE::IO::ImportResult result = fs->getImporter(options).import(in);
+	if (result.documents != numDocuments + 1 || result.rejected != 2 || result.bytes != ndjson.str().size() ||
+		result.rejectedLines.size() != 2 || result.rejectedLines[0] != 12 || result.rejectedLines[1] != numDocuments + 5) {
+		return -1;
+	}
+
+	for (int i = 0; i < numDocuments; i += 97) {
+		File f = fs->find("TestImport" + toString(i));
+		if (f == STORAGE::NOFILE) {
+			return -1;
+		}
+		STORAGE::IO::Document document = fs->getDocumentReader(f).read();
+		JsonNode *id = document.find(document.root(), "id");
+		if (!document.isTape() || id == nullptr || id->value.toNumber() != i) {
+			return -1;
+		}
+	}
+
+	// The replaced file keeps its old version behind the imported one
+	STORAGE::IO::Document replaced = fs->getDocumentReader(existing).read();
+	JsonNode *padding = replaced.find(replaced.root(), "padding");
+	if (padding == nullptr || strlen(padding->value.toString()) != 10000 || fs->getHeader(existing).version != 2) {
+		return -1;
+	}
+
+	// Numeric keys must be whole and fit a long long
+	options.prefix = "TestRange";
+	std::istringstream keys("{\"id\" : 1e300}\n{\"id\" : -1e19}\n{\"id\" : 1.5}\n{\"id\" : 1e18}\n");
+	result = fs->getImporter(options).import(keys);
+	if (result.documents != 1 || result.rejected != 3 || !fs->exists("TestRange1000000000000000000")) {
+		return -1;
+	}
+
+	// Without a key, documents are named by line and stored as they were given
+	options.keyPath.clear();
+	options.prefix = "TestLine";
+	options.tape = false;
+	std::istringstream lines("[1]\n\n  {\"a\" : true}  \n");
+	result = fs->getImporter(options).import(lines);
+	if (result.documents != 2 || result.rejected != 0 || fs->exists("TestLine2") ||
+		fs->getReader(fs->find("TestLine3")).readString(fs->getHeader(fs->find("TestLine3")).size) != "{\"a\" : true}") {
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,32 @@
+#include "Filesystem.h"
+#include "Testing.h"
+
+#include <string>
+#include <vector>
+
+// Write a batch of files, then read them back in a different order along with a missing file
+int TestMultiGet(STORAGE::Filesystem *fs) {
+	std::vector<std::pair<std::string, std::string>> pairs;
+	for (int i = 0; i < numNames; ++i) {
+		pairs.push_back(std::make_pair("TestFile" + toString(i), random_string(dataSize / (i + 1))));
+	}
+	fs->multiPut(pairs);
+
+	std::vector<std::string> names;
+	names.push_back("Missing");
+	for (int i = numNames - 1; i >= 0; --i) {
+		names.push_back(pairs[i].first);
+	}
+	STORAGE::MultiGetResult res = fs->multiGet(names);
+
+	if (res.found[0] || fs->exists("Missing")) {
+		return -1;
+	}
+	for (int i = 1; i <= numNames; ++i) {
+		if (!res.found[i] || res.get(i).compare(pairs[numNames - i].second) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,90 @@
+#include "Filesystem.h"
+#include "Testing.h"
+
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+
+// Query documents stored as tapes and as text, alongside files that are not JSON at all
+int TestQuery(STORAGE::Filesystem *fs) {
+	const int numDocuments = 600;
+
+	std::map<std::string, std::string> expected;	// Name to owner, for open documents older than 30
+	for (int i = 0; i < numDocuments; ++i) {
+		std::string name = "TestQuery" + toString(i);
+		std::string owner = random_string(8);
+		bool open = i % 3 != 0;
+		std::ostringstream json;
+		json << "{\"id\" : " << i << ", \"status\" : \"" << (open ? "open" : "closed") << "\", ";
+		if (i % 7 != 0) {
+			json << "\"age\" : " << i % 60 << ", ";
+		}
+		json << "\"tags\" : [\"a\", " << (i % 2 == 0 ? "true" : "false") << "], \"owner\" : \"" << owner << "\"}";
+
+		File f = fs->select(name);
+		if (i % 2 == 0) {
+			STORAGE::IO::DocumentWriter writer = fs->getDocumentWriter(f);
+			writer.write(json.str().c_str(), json.str().size());
+		} else {
+			STORAGE::IO::Writer writer = fs->getWriter(f);
+			writer.write(json.str().c_str(), json.str().size());
+		}
+		if (open && i % 7 != 0 && i % 60 > 30) {
+			expected[name] = owner;
+		}
+	}
+	fs->put("TestQueryText", "not json", 8);
+
+	STORAGE::IO::Query query;
+	query.where("status", STORAGE::IO::EQUAL, "open").where("age", STORAGE::IO::GREATER, 30).select("id").select("owner").select("missing");
+	bool failed = false;
+	size_t matched = fs->query(query, [&](File, const std::string &name, const std::vector<JsonValue> &fields) {
+		auto it = expected.find(name);
+		if (it == expected.end() || fields.size() != 3 || fields[0].getTag() != JSON_NUMBER ||
+			"TestQuery" + toString((int)fields[0].toNumber()) != name || fields[2].getTag() != JSON_NULL) {
+			failed = true;
+			return;
+		}
+		// Text documents hold slices, tapes hold strings
+		JsonValue owner = fields[1];
+		std::string value = owner.getTag() == JSON_SLICE ? std::string(owner.toSlice()->data, owner.toSlice()->length) : std::string(owner.toString());
+		failed = failed || value != it->second;
+		expected.erase(it);
+	});
+	if (failed || matched == 0 || !expected.empty()) {
+		return -1;
+	}
+
+	// Paths into arrays, booleans, fields that are missing, and values of another kind
+	STORAGE::IO::Query flags;
+	flags.where("tags[1]", STORAGE::IO::EQUAL, true);
+	if (fs->query(flags, [](File, const std::string &, const std::vector<JsonValue> &) {}) != numDocuments / 2) {
+		return -1;
+	}
+	STORAGE::IO::Query missing;
+	missing.where("age", STORAGE::IO::EXISTS);
+	if (fs->query(missing, [](File, const std::string &, const std::vector<JsonValue> &) {}) != numDocuments - (numDocuments + 6) / 7) {
+		return -1;
+	}
+	STORAGE::IO::Query kind;
+	kind.where("status", STORAGE::IO::NOTEQUAL, 1).where("id", STORAGE::IO::LESSEQUAL, 9.5);
+	if (fs->query(kind, [](File, const std::string &, const std::vector<JsonValue> &) {}) != 10) {
+		return -1;
+	}
+
+	// Integers beyond 2^53 compare exactly, in tapes and in text
+	const char *big = "{\"big\" : 9007199254740993}";
+	fs->getDocumentWriter(fs->select("TestQueryBigTape")).write(big, strlen(big));
+	fs->put("TestQueryBigText", big, strlen(big));
+	STORAGE::IO::Query exact;
+	exact.where("big", STORAGE::IO::EQUAL, (int64_t)9007199254740993LL);
+	STORAGE::IO::Query neighbour;
+	neighbour.where("big", STORAGE::IO::EQUAL, (int64_t)9007199254740992LL);
+	if (fs->query(exact, [](File, const std::string &, const std::vector<JsonValue> &) {}) != 2 ||
+		fs->query(neighbour, [](File, const std::string &, const std::vector<JsonValue> &) {}) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,75 @@
+#include "Filestream.h"
+#include "Filesystem.h"
+#include "Testing.h"
+
+#include <string>
+#include <vector>
+
+static const int chunkSize = 4096;
+static const int streamSize = 3 * chunkSize + 1000;
+
+// Stream an object across several chunks in odd sized pieces and read it back
+int TestStream(STORAGE::Filesystem *fs) {
+	std::string data = random_string(streamSize);
+	{
+		STORAGE::IO::StreamWriter writer = fs->getStreamWriter("TestStream", chunkSize);
+		for (size_t pos = 0; pos < data.size(); pos += 333) {
+			writer.write(data.c_str() + pos, std::min((size_t)333, data.size() - pos));
+		}
+	} // The last chunk and the manifest are written here
+
+	STORAGE::IO::StreamReader reader = fs->getStreamReader("TestStream");
+	if (reader.size() != data.size()) {
+		return -1;
+	}
+
+	std::string res;
+	std::vector<char> buffer(1500);
+	FileSize amt;
+	while ((amt = reader.read(buffer.data(), buffer.size())) > 0) {
+		res.append(buffer.data(), amt);
+	}
+	if (res.compare(data) != 0) {
+		return -1;
+	}
+
+	// Read across a chunk boundary
+	reader.seek(chunkSize - 10);
+	amt = reader.read(buffer.data(), 20);
+	if (amt != 20 || data.compare(chunkSize - 10, 20, std::string(buffer.data(), 20)) != 0) {
+		return -1;
+	}
+
+	// Replacing the object with a smaller one removes the chunks it no longer uses
+	std::string small = random_string(1000);
+	{
+		STORAGE::IO::StreamWriter writer = fs->getStreamWriter("TestStream", chunkSize);
+		writer.write(small.c_str(), small.size());
+	}
+	STORAGE::IO::StreamReader smallReader = fs->getStreamReader("TestStream");
+	amt = smallReader.read(buffer.data(), buffer.size());
+	if (amt != small.size() || small.compare(0, amt, std::string(buffer.data(), amt)) != 0 ||
+		fs->exists(STORAGE::IO::chunkName("TestStream", 1))) {
+		return -1;
+	}
+
+	// A stream missing a chunk fails to read instead of creating the chunk and returning short data
+	{
+		STORAGE::IO::StreamWriter writer = fs->getStreamWriter("TestStreamTruncated", chunkSize);
+		writer.write(data.c_str(), data.size());
+	}
+	std::string missing = STORAGE::IO::chunkName("TestStreamTruncated", 1);
+	fs->unlink(fs->select(missing));
+	STORAGE::IO::StreamReader truncatedReader = fs->getStreamReader("TestStreamTruncated");
+	try {
+		while (truncatedReader.read(buffer.data(), buffer.size()) > 0) {
+		}
+		return -1;
+	} catch (STORAGE::IO::FileNotFoundException &) {
+	}
+	if (fs->exists(missing)) {
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,360 @@
+#include "ThreadPool.h"
+#include "Testing.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The owner pushes and pops while thieves steal, every task is taken exactly once
+int TestWorkStealing(STORAGE::Filesystem *) {
+	const int numTasks = 20000;
+	const int numThieves = 3;
+	std::vector<std::atomic<int>> runs(numTasks);
+	for (auto &r : runs) {
+		r = 0;
+	}
+
+	// Pops are LIFO and steals are FIFO, across a grow
+	{
+		THREADING::WorkDeque deque;
+		for (int i = 0; i < 100; ++i) {
+			deque.push(new THREADING::Task([&runs, i] { runs[i]++; }));
+		}
+		THREADING::Task *first = deque.steal();
+		THREADING::Task *last = deque.pop();
+		(*first)();
+		(*last)();
+		delete first;
+		delete last;
+		if (runs[0] != 1 || runs[99] != 1) {
+			return -1;
+		}
+		while (THREADING::Task *t = deque.pop()) {
+			(*t)();
+			delete t;
+		}
+		if (!deque.empty() || deque.steal() != nullptr) {
+			return -1;
+		}
+		for (auto &r : runs) {
+			r = 0;
+		}
+	}
+
+	THREADING::WorkDeque deque;
+	std::atomic<bool> done(false);
+	std::vector<std::thread> thieves;
+	for (int i = 0; i < numThieves; ++i) {
+		thieves.push_back(std::thread([&] {
+			while (!done) {
+				if (THREADING::Task *t = deque.steal()) {
+					(*t)();
+					delete t;
+				}
+			}
+		}));
+	}
+	for (int i = 0; i < numTasks; ++i) {
+		deque.push(new THREADING::Task([&runs, i] { runs[i]++; }));
+		if (i % 3 == 0) {
+			if (THREADING::Task *t = deque.pop()) {
+				(*t)();
+				delete t;
+			}
+		}
+	}
+	// A pop only comes back empty once the deque is, even when a thief took the last task
+	while (THREADING::Task *t = deque.pop()) {
+		(*t)();
+		delete t;
+	}
+	done = true;
+	for (auto &t : thieves) {
+		t.join();
+	}
+	for (auto &r : runs) {
+		if (r != 1) {
+			return -1;
+		}
+	}
+
+	// Tasks queued by a worker that then blocks are run by the other workers
+	THREADING::ThreadPool pool(4);
+	auto outer = pool.enqueue([&pool] {
+		std::vector<std::future<std::thread::id>> inner;
+		for (int i = 0; i < 64; ++i) {
+			inner.push_back(pool.enqueue([] {
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+				return std::this_thread::get_id();
+			}));
+		}
+		std::set<std::thread::id> ids;
+		for (auto &f : inner) {
+			ids.insert(f.get());
+		}
+		return ids.count(std::this_thread::get_id()) == 0 && !ids.empty();
+	});
+	if (!outer.get()) {
+		return -1;
+	}
+
+	// Tasks from outside the pool are shared out between the workers
+	std::vector<std::future<int>> results;
+	for (int i = 0; i < 1000; ++i) {
+		results.push_back(pool.enqueue([](int x) { return x * 2; }, i));
+	}
+	for (int i = 0; i < 1000; ++i) {
+		if (results[i].get() != i * 2) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// Bulk enqueue, bounded queues that block or reject, and background work that keeps out of the way
+int TestThreadPoolQueues(STORAGE::Filesystem *) {
+	const std::chrono::seconds timeout(10);
+
+	{
+		THREADING::ThreadPool pool(4);
+		std::vector<std::function<int()>> batch;
+		for (int i = 0; i < 1000; ++i) {
+			batch.push_back([i] { return i; });
+		}
+		auto results = pool.enqueueBulk(batch.begin(), batch.end());
+		auto background = pool.enqueueBulk(batch.begin(), batch.end(), THREADING::ThreadPool::BACKGROUND);
+		for (int i = 0; i < 1000; ++i) {
+			if (results[i].get() != i || background[i].get() != i) {
+				return -1;
+			}
+		}
+	}
+
+	// A full REJECT pool throws, for single tasks and batches alike
+	{
+		std::promise<void> started, gate;
+		std::shared_future<void> open = gate.get_future().share();
+		THREADING::ThreadPool pool(1, 2, THREADING::ThreadPool::REJECT);
+		auto blocker = pool.enqueue([&started, open] { started.set_value(); open.wait(); });
+		started.get_future().wait();
+		auto a = pool.enqueue([] { return 1; });
+		auto b = pool.enqueue([] { return 2; });
+		bool rejected = false, bulkRejected = false;
+		try {
+			pool.enqueue([] { return 3; });
+		} catch (THREADING::QueueFullException &) {
+			rejected = true;
+		}
+		std::vector<std::function<int()>> batch(1, [] { return 4; });
+		try {
+			pool.enqueueBulk(batch.begin(), batch.end());
+		} catch (THREADING::QueueFullException &) {
+			bulkRejected = true;
+		}
+		gate.set_value();
+		if (!rejected || !bulkRejected || a.get() != 1 || b.get() != 2) {
+			return -1;
+		}
+	}
+
+	// A full BLOCK pool holds the producer until a task is taken
+	{
+		std::promise<void> started, gate;
+		std::shared_future<void> open = gate.get_future().share();
+		THREADING::ThreadPool pool(1, 1, THREADING::ThreadPool::BLOCK);
+		auto blocker = pool.enqueue([&started, open] { started.set_value(); open.wait(); });
+		started.get_future().wait();
+		auto a = pool.enqueue([] { return 1; });
+		std::atomic<bool> queued(false);
+		std::future<int> b;
+		std::thread producer([&] {
+			b = pool.enqueue([] { return 2; });
+			queued = true;
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		bool heldBack = !queued;
+		gate.set_value();
+		producer.join();
+		if (!heldBack || a.get() != 1 || b.get() != 2) {
+			return -1;
+		}
+	}
+
+	// Background tasks never take the last worker
+	{
+		std::promise<void> started, gate;
+		std::shared_future<void> open = gate.get_future().share();
+		std::atomic<bool> first(true);
+		THREADING::ThreadPool pool(2);
+		std::vector<std::future<void>> background;
+		for (int i = 0; i < 2; ++i) {
+			background.push_back(pool.enqueueBackground([&started, &first, open] {
+				if (first.exchange(false)) {
+					started.set_value();
+				}
+				open.wait();
+			}));
+		}
+		started.get_future().wait();
+		auto foreground = pool.enqueue([] { return 1; });
+		bool ran = foreground.wait_for(timeout) == std::future_status::ready;
+		gate.set_value();
+		if (!ran || foreground.get() != 1) {
+			return -1;
+		}
+	}
+
+	// A single worker runs background tasks only when nothing else is queued
+	{
+		std::promise<void> started, gate;
+		std::shared_future<void> open = gate.get_future().share();
+		std::mutex m;
+		std::string order;
+		THREADING::ThreadPool pool(1);
+		auto blocker = pool.enqueue([&started, open] { started.set_value(); open.wait(); });
+		started.get_future().wait();
+		auto background = pool.enqueueBackground([&] { std::lock_guard<std::mutex> lk(m); order += 'b'; });
+		auto foreground = pool.enqueue([&] { std::lock_guard<std::mutex> lk(m); order += 'f'; });
+		gate.set_value();
+		background.get();
+		foreground.get();
+		if (order != "fb") {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// Node and worker tasks only run where they were sent, pinned or not
+int TestThreadPoolAffinity(STORAGE::Filesystem *) {
+	const THREADING::ThreadPool::Affinity affinities[] = { THREADING::ThreadPool::UNPINNED, THREADING::ThreadPool::PIN_NODE, THREADING::ThreadPool::PIN_CPU };
+	for (THREADING::ThreadPool::Affinity affinity : affinities) {
+		THREADING::ThreadPool pool(4, 0, THREADING::ThreadPool::BLOCK, affinity);
+		if (pool.workerCount() != 4 || pool.nodeCount() < 1 || (affinity == THREADING::ThreadPool::UNPINNED && pool.nodeCount() != 1)) {
+			return -1;
+		}
+
+		// Learn which thread is which worker, every task sent to a worker runs on the same thread
+		std::map<std::thread::id, size_t> workers;
+		for (size_t w = 0; w < pool.workerCount(); ++w) {
+			std::vector<std::future<std::thread::id>> ids;
+			for (int i = 0; i < 10; ++i) {
+				ids.push_back(pool.enqueueOnWorker(w, [] { return std::this_thread::get_id(); }));
+			}
+			std::thread::id id = ids[0].get();
+			for (size_t i = 1; i < ids.size(); ++i) {
+				if (ids[i].get() != id) {
+					return -1;
+				}
+			}
+			workers[id] = w;
+			if (pool.nodeOf(w) >= pool.nodeCount()) {
+				return -1;
+			}
+		}
+		if (workers.size() != pool.workerCount()) {
+			return -1;
+		}
+
+		for (size_t n = 0; n < pool.nodeCount(); ++n) {
+			std::vector<std::future<std::thread::id>> ids;
+			for (int i = 0; i < 20; ++i) {
+				ids.push_back(pool.enqueueOnNode(n, [] { return std::this_thread::get_id(); }));
+			}
+			for (auto &id : ids) {
+				auto it = workers.find(id.get());
+				if (it == workers.end() || pool.nodeOf(it->second) != n) {
+					return -1;
+				}
+			}
+		}
+
+		bool badNode = false, badWorker = false;
+		try {
+			pool.enqueueOnNode(pool.nodeCount(), [] {});
+		} catch (std::out_of_range &) {
+			badNode = true;
+		}
+		try {
+			pool.enqueueOnWorker(pool.workerCount(), [] {});
+		} catch (std::out_of_range &) {
+			badWorker = true;
+		}
+		if (!badNode || !badWorker) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// Every task is counted once and the queue is empty once they are done
+int TestThreadPoolStats(STORAGE::Filesystem *) {
+	const int numTasks = 100;
+	const std::chrono::seconds timeout(10);
+
+	THREADING::ThreadPool pool(4);
+	std::vector<std::future<std::future<int>>> outer;
+	std::vector<std::future<int>> background;
+	for (int i = 0; i < numTasks; ++i) {
+		// Each task queues another from inside the pool while background tasks arrive from outside
+		outer.push_back(pool.enqueue([&pool, i] { return pool.enqueue([i] { return i; }); }));
+		background.push_back(pool.enqueueBackground([i] { return i; }));
+	}
+	for (int i = 0; i < numTasks; ++i) {
+		if (outer[i].get().get() != i || background[i].get() != i) {
+			return -1;
+		}
+	}
+
+	// A task is counted just after its result is set
+	THREADING::ThreadPoolStats stats = pool.getStats();
+	auto deadline = std::chrono::steady_clock::now() + timeout;
+	while (stats.completed < 3 * numTasks && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		stats = pool.getStats();
+	}
+	uint64_t tasks = 0;
+	for (const THREADING::WorkerStats &w : stats.workers) {
+		tasks += w.tasks;
+	}
+	if (stats.submitted != 3 * numTasks || stats.completed != 3 * numTasks || stats.rejected != 0 ||
+		tasks != stats.completed || stats.workers.size() != pool.workerCount() || stats.queueDepth != 0 ||
+		stats.maxQueueDepth < 1 || stats.depth.count != stats.submitted ||
+		stats.wait.count != stats.completed || stats.run.count != stats.completed ||
+		stats.run.percentile(0.5) > stats.run.max || stats.utilization() < 0 || stats.utilization() > 1) {
+		return -1;
+	}
+
+	pool.resetStats();
+	stats = pool.getStats();
+	if (stats.submitted != 0 || stats.completed != 0 || stats.wait.count != 0 || stats.run.count != 0) {
+		return -1;
+	}
+
+	// Rejected tasks are counted but not submitted
+	{
+		std::promise<void> started, gate;
+		std::shared_future<void> open = gate.get_future().share();
+		THREADING::ThreadPool bounded(1, 1, THREADING::ThreadPool::REJECT);
+		auto blocker = bounded.enqueue([&started, open] { started.set_value(); open.wait(); });
+		started.get_future().wait();
+		auto queued = bounded.enqueue([] {});
+		try {
+			bounded.enqueue([] {});
+		} catch (THREADING::QueueFullException &) {}
+		stats = bounded.getStats();
+		gate.set_value();
+		if (stats.submitted != 2 || stats.rejected != 1 || stats.queueDepth != 1) {
+			return -1;
+		}
+	}
+	return 0;
+}
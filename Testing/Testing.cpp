@@ -69,6 +69,22 @@ void test() {
 	fn.push_back([] { TestWrapper("MVCC", TestMVCC); });
 	fn.push_back([] { TestWrapper("Concurrent Multi-File MVCC", TestConcurrentMultiFileMVCC); });
 	//fn.push_back([] { TestWrapper("Unlink", TestUnlink); });
+	fn.push_back([] { TestWrapper("Buffered Write", TestBufferedWrite); });
+	fn.push_back([] { TestWrapper("Stream", TestStream); });
+	fn.push_back([] { TestWrapper("Async", TestAsync); });
+	fn.push_back([] { TestWrapper("Multi Get", TestMultiGet); });
+	fn.push_back([] { TestWrapper("Find", TestFind); });
+	fn.push_back([] { TestWrapper("ForEach", TestForEach); });
+	fn.push_back([] { TestWrapper("Coroutine", TestCoroutine); });
+	fn.push_back([] { TestWrapper("Document", TestDocument); });
+	fn.push_back([] { TestWrapper("Import", TestImport); });
+	fn.push_back([] { TestWrapper("Build", TestBuild); });
+	fn.push_back([] { TestWrapper("Query", TestQuery); });
+	fn.push_back([] { TestWrapper("Column", TestColumn); });
+	fn.push_back([] { TestWrapper("Work Stealing", TestWorkStealing); });
+	fn.push_back([] { TestWrapper("ThreadPool Queues", TestThreadPoolQueues); });
+	fn.push_back([] { TestWrapper("ThreadPool Affinity", TestThreadPoolAffinity); });
+	fn.push_back([] { TestWrapper("ThreadPool Stats", TestThreadPoolStats); });
 
 	SECURITY_ATTRIBUTES attr;
 	attr.nLength = sizeof(SECURITY_ATTRIBUTES);
@@ -28,6 +28,22 @@ int TestConcurrentReadWrite(STORAGE::Filesystem *);
 int TestConcurrentMultiFile(STORAGE::Filesystem *);
 int TestConcurrentMultiFileMVCC(STORAGE::Filesystem *);
 int TestUnlink(STORAGE::Filesystem *);
+int TestBufferedWrite(STORAGE::Filesystem *);
+int TestStream(STORAGE::Filesystem *);
+int TestAsync(STORAGE::Filesystem *);
+int TestMultiGet(STORAGE::Filesystem *);
+int TestFind(STORAGE::Filesystem *);
+int TestForEach(STORAGE::Filesystem *);
+int TestCoroutine(STORAGE::Filesystem *);
+int TestDocument(STORAGE::Filesystem *);
+int TestImport(STORAGE::Filesystem *);
+int TestBuild(STORAGE::Filesystem *);
+int TestQuery(STORAGE::Filesystem *);
+int TestColumn(STORAGE::Filesystem *);
+int TestWorkStealing(STORAGE::Filesystem *);
+int TestThreadPoolQueues(STORAGE::Filesystem *);
+int TestThreadPoolAffinity(STORAGE::Filesystem *);
+int TestThreadPoolStats(STORAGE::Filesystem *);
 
 typedef std::function<void()> TestWrapper_t;
 
@@ -1,3 +1 @@
 #include "ThreadPool.h"
-
-// TODO:  Testing
\ No newline at end of file
@@ -3,79 +3,1044 @@
 #pragma once
 
 #include <vector>
-#include <queue>
+#include <deque>
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 #include <future>
 #include <functional>
 #include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <algorithm>
+#include <string>
+#include <chrono>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <Windows.h>
+#include <intrin.h>
+#elif defined(linux) || defined(__linux)
+#include <pthread.h>
+#include <sched.h>
+#include <cstdio>
+#include <fstream>
+#endif
 
 namespace THREADING {
+	// The result of calling an F with Args.  std::result_of was removed in C++20 and std::invoke_result_t
+	// only arrived in C++17.
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+	template<class F, class... Args>
+	using ResultOf = std::invoke_result_t<F, Args...>;
+#else
+	template<class F, class... Args>
+	using ResultOf = typename std::result_of<F(Args...)>::type;
+#endif
+
+	/*
+	 * A type erased, move only callable.  Callables that fit in the inline buffer (a packaged_task does) are
+	 * stored without another heap allocation.
+	 */
+	class Task {
+	public:
+		static const size_t INLINE_SIZE = 48;
+
+		template<class F>
+		explicit Task(F&&);
+		Task(Task&&);
+		Task(const Task&) = delete;
+		~Task();
+		void operator()() { invoke(&storage); }
+
+		uint64_t enqueued;	// steady clock nanoseconds, for the wait time statistics
+
+	private:
+		typedef void(*InvokeFn)(void *);
+		typedef void(*ManageFn)(void *, void *);	// Move from src into dst (if given) and destroy src
+
+		template<class F> struct Inline {
+			static void invoke(void *p) { (*static_cast<F*>(p))(); }
+			static void manage(void *dst, void *src) {
+				if (dst) {
+					new (dst) F(std::move(*static_cast<F*>(src)));
+				}
+				static_cast<F*>(src)->~F();
+			}
+		};
+
+		template<class F> struct Boxed {
+			static void invoke(void *p) { (**static_cast<F**>(p))(); }
+			static void manage(void *dst, void *src) {
+				if (dst) {
+					*static_cast<F**>(dst) = *static_cast<F**>(src);
+				} else {
+					delete *static_cast<F**>(src);
+				}
+			}
+		};
+
+		typename std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type storage;
+		InvokeFn invoke;
+		ManageFn manage;
+	};
+
+	template<class F>
+	inline Task::Task(F&& f) : enqueued(0) {
+		typedef typename std::decay<F>::type Fn;
+		if (sizeof(Fn) <= INLINE_SIZE && alignof(Fn) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<Fn>::value) {
+			new (&storage) Fn(std::forward<F>(f));
+			invoke = &Inline<Fn>::invoke;
+			manage = &Inline<Fn>::manage;
+		} else {
+			*reinterpret_cast<Fn**>(&storage) = new Fn(std::forward<F>(f));
+			invoke = &Boxed<Fn>::invoke;
+			manage = &Boxed<Fn>::manage;
+		}
+	}
+
+	inline Task::Task(Task&& other) : enqueued(other.enqueued), invoke(other.invoke), manage(other.manage) {
+		manage(&storage, &other.storage);
+		other.manage = nullptr;
+	}
+
+	inline Task::~Task() {
+		if (manage) {
+			manage(nullptr, &storage);
+		}
+	}
+
+	/*
+	 * Chase-Lev work stealing deque.  The owning worker pushes and pops at the bottom (LIFO), any other
+	 * worker may steal from the top (FIFO).  Arrays replaced by a grow are kept until the deque is destroyed
+	 * because a thief may still be reading from them.
+	 */
+	class WorkDeque {
+	public:
+		WorkDeque() : top(0), bottom(0), array(new Array(64)) {}
+		~WorkDeque();
+		void push(Task *);
+		Task *pop();
+		Task *steal();
+		bool empty() { return top.load(std::memory_order_relaxed) >= bottom.load(std::memory_order_relaxed); }
+
+	private:
+		struct Array {
+			int64_t capacity;
+			std::unique_ptr<std::atomic<Task*>[]> slots;
+
+			explicit Array(int64_t cap) : capacity(cap), slots(new std::atomic<Task*>[(size_t)cap]) {}
+			Task *get(int64_t i) { return slots[(size_t)(i & (capacity - 1))].load(std::memory_order_relaxed); }
+			void put(int64_t i, Task *t) { slots[(size_t)(i & (capacity - 1))].store(t, std::memory_order_relaxed); }
+		};
+
+		std::atomic<int64_t> top;
+		std::atomic<int64_t> bottom;
+		std::atomic<Array*> array;
+		std::vector<std::unique_ptr<Array>> retired;
+	};
+
+	inline WorkDeque::~WorkDeque() {
+		Array *a = array.load(std::memory_order_relaxed);
+		for (int64_t i = top.load(std::memory_order_relaxed); i < bottom.load(std::memory_order_relaxed); ++i) {
+			delete a->get(i);
+		}
+		delete a;
+	}
+
+	inline void WorkDeque::push(Task *task) {
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_acquire);
+		Array *a = array.load(std::memory_order_relaxed);
+		if (b - t > a->capacity - 1) {
+			Array *bigger = new Array(a->capacity * 2);
+			for (int64_t i = t; i < b; ++i) {
+				bigger->put(i, a->get(i));
+			}
+			retired.emplace_back(a);
+			array.store(bigger, std::memory_order_release);
+			a = bigger;
+		}
+		a->put(b, task);
+		// Publishes the task to a thief that reads the new bottom
+		bottom.store(b + 1, std::memory_order_release);
+	}
+
+	inline Task *WorkDeque::pop() {
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		Array *a = array.load(std::memory_order_relaxed);
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+
+		if (t > b) {
+			// Empty
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		Task *task = a->get(b);
+		if (t == b) {
+			// Last element, race against thieves for it
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				task = nullptr;
+			}
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return task;
+	}
+
+	inline Task *WorkDeque::steal() {
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+
+		if (t >= b) {
+			return nullptr;
+		}
+
+		Array *a = array.load(std::memory_order_acquire);
+		Task *task = a->get(t);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			return nullptr;	// Lost the race to another thief or the owner
+		}
+		return task;
+	}
+
+	/*
+	 * A log2 histogram: bucket i counts the values that are i bits long, so bucket 0 holds zeros and
+	 * bucket 11 holds 1024 to 2047.  Times are in nanoseconds.
+	 */
+	struct Histogram {
+		static const size_t BUCKETS = 65;
+
+		uint64_t count;
+		uint64_t sum;
+		uint64_t max;
+		uint64_t buckets[BUCKETS];
+
+		Histogram() : count(0), sum(0), max(0) {
+			std::fill(buckets, buckets + BUCKETS, 0);
+		}
+
+		static size_t bucket(uint64_t value) {
+#if defined(_MSC_VER) && defined(_WIN64)
+			unsigned long bit;
+			return _BitScanReverse64(&bit, value) ? bit + 1 : 0;
+#elif defined(__GNUC__) || defined(__clang__)
+			return value ? 64 - __builtin_clzll(value) : 0;
+#else
+			size_t bits = 0;
+			for (; value; value >>= 1) {
+				++bits;
+			}
+			return bits;
+#endif
+		}
+
+		double mean() const { return count ? (double)sum / count : 0; }
+
+		// An upper bound on the given fraction (0 to 1) of the values
+		uint64_t percentile(double fraction) const {
+			uint64_t wanted = (uint64_t)(fraction * count + 0.5), seen = 0;
+			for (size_t i = 0; i < BUCKETS; ++i) {
+				seen += buckets[i];
+				if (seen >= wanted && seen > 0) {
+					uint64_t bound = i == 0 ? 0 : i >= 64 ? UINT64_MAX : (1ULL << i) - 1;
+					return (std::min)(bound, max);
+				}
+			}
+			return max;
+		}
+
+		void merge(const Histogram &other) {
+			count += other.count;
+			sum += other.sum;
+			max = (std::max)(max, other.max);
+			for (size_t i = 0; i < BUCKETS; ++i) {
+				buckets[i] += other.buckets[i];
+			}
+		}
+	};
+
+	/*
+	 * The live side of a Histogram.  Each one has a single writer at a time (a worker, or a producer
+	 * holding the queue mutex) so relaxed atomics are enough and readers see a near consistent snapshot.
+	 */
+	class HistogramRecorder {
+	public:
+		HistogramRecorder() { reset(); }
+
+		void record(uint64_t value) {
+			buckets[Histogram::bucket(value)].fetch_add(1, std::memory_order_relaxed);
+			count.fetch_add(1, std::memory_order_relaxed);
+			sum.fetch_add(value, std::memory_order_relaxed);
+			if (value > max.load(std::memory_order_relaxed)) {
+				max.store(value, std::memory_order_relaxed);
+			}
+		}
+
+		void snapshot(Histogram &out) const {
+			Histogram h;
+			h.count = count.load(std::memory_order_relaxed);
+			h.sum = sum.load(std::memory_order_relaxed);
+			h.max = max.load(std::memory_order_relaxed);
+			for (size_t i = 0; i < Histogram::BUCKETS; ++i) {
+				h.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+			}
+			out.merge(h);
+		}
+
+		void reset() {
+			count.store(0, std::memory_order_relaxed);
+			sum.store(0, std::memory_order_relaxed);
+			max.store(0, std::memory_order_relaxed);
+			for (size_t i = 0; i < Histogram::BUCKETS; ++i) {
+				buckets[i].store(0, std::memory_order_relaxed);
+			}
+		}
+
+	private:
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> sum;
+		std::atomic<uint64_t> max;
+		std::atomic<uint64_t> buckets[Histogram::BUCKETS];
+	};
+
+	struct WorkerStats {
+		size_t node;
+		uint64_t tasks;			// Tasks run
+		uint64_t steals;		// Tasks taken from another worker's deque
+		uint64_t busyNanos;		// Time spent running tasks
+		uint64_t idleNanos;		// Time spent asleep waiting for work
+	};
+
+	/*
+	 * A snapshot of a pool's counters since it was created or last reset.
+	 */
+	struct ThreadPoolStats {
+		uint64_t submitted;		// Tasks accepted
+		uint64_t rejected;		// Tasks refused by a full REJECT pool
+		uint64_t completed;		// Tasks run
+		size_t queueDepth;		// Tasks queued but not started, right now
+		size_t maxQueueDepth;
+		Histogram depth;		// Queue depth seen by each enqueue
+		Histogram wait;			// Enqueue to start, in nanoseconds
+		Histogram run;			// Start to finish, in nanoseconds
+		std::vector<WorkerStats> workers;
+
+		// The fraction of the workers' time that was spent running tasks
+		double utilization() const {
+			uint64_t busy = 0, idle = 0;
+			for (const WorkerStats &w : workers) {
+				busy += w.busyNanos;
+				idle += w.idleNanos;
+			}
+			return busy + idle ? (double)busy / (busy + idle) : 0;
+		}
+	};
+
+	/*
+	 * Thrown by a bounded pool that rejects work when its queue is full.
+	 */
+	class QueueFullException : public std::runtime_error {
+	public:
+		QueueFullException() : std::runtime_error("ThreadPool queue is full") {}
+	};
+
+	/*
+	 * The CPUs of each NUMA node that this process may run on.  Machines (or platforms) without NUMA
+	 * information are reported as a single node holding every CPU.
+	 */
+	inline std::vector< std::vector<unsigned> > numaTopology() {
+		std::vector< std::vector<unsigned> > nodes;
+#if defined(_WIN32) || defined(_WIN64)
+		ULONG highest = 0;
+		if (GetNumaHighestNodeNumber(&highest)) {
+			for (ULONG node = 0; node <= highest; ++node) {
+				ULONGLONG mask = 0;
+				std::vector<unsigned> cpus;
+				if (GetNumaNodeProcessorMask((UCHAR)node, &mask)) {
+					for (unsigned cpu = 0; cpu < 64; ++cpu) {
+						if (mask & (1ULL << cpu)) {
+							cpus.push_back(cpu);
+						}
+					}
+				}
+				if (!cpus.empty()) {
+					nodes.push_back(cpus);
+				}
+			}
+		}
+#elif defined(linux) || defined(__linux)
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		bool restricted = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+		for (unsigned node = 0;; ++node) {
+			// cpulist looks like "0-7,16-23"
+			std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+			if (!in) {
+				break;
+			}
+			std::vector<unsigned> cpus;
+			std::string range;
+			while (std::getline(in, range, ',')) {
+				unsigned first = 0, last = 0;
+				int fields = sscanf(range.c_str(), "%u-%u", &first, &last);
+				if (fields < 1) {
+					continue;
+				}
+				if (fields == 1) {
+					last = first;
+				}
+				for (unsigned cpu = first; cpu <= last; ++cpu) {
+					if (!restricted || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))) {
+						cpus.push_back(cpu);
+					}
+				}
+			}
+			if (!cpus.empty()) {
+				nodes.push_back(cpus);
+			}
+		}
+#endif
+		if (nodes.empty()) {
+			std::vector<unsigned> cpus;
+			unsigned count = std::thread::hardware_concurrency();
+			for (unsigned cpu = 0; cpu < (count ? count : 1); ++cpu) {
+				cpus.push_back(cpu);
+			}
+			nodes.push_back(cpus);
+		}
+		return nodes;
+	}
+
+	/*
+	 * Restrict the calling thread to the given CPUs.  Returns false if the platform does not support it or
+	 * the request was refused, in which case the thread is left where it was.
+	 */
+	inline bool pinCurrentThread(const std::vector<unsigned> &cpus) {
+		if (cpus.empty()) {
+			return false;
+		}
+#if defined(_WIN32) || defined(_WIN64)
+		DWORD_PTR mask = 0;
+		for (unsigned cpu : cpus) {
+			if (cpu < sizeof(DWORD_PTR) * 8) {
+				mask |= (DWORD_PTR)1 << cpu;
+			}
+		}
+		return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(linux) || defined(__linux)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (unsigned cpu : cpus) {
+			if (cpu < CPU_SETSIZE) {
+				CPU_SET(cpu, &set);
+			}
+		}
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+		return false;
+#endif
+	}
+
+	/*
+	 * Work stealing thread pool.  Each worker owns a deque; tasks enqueued from inside a worker go to that
+	 * worker's deque and are run LIFO, tasks enqueued from outside the pool go to a shared queue.  A worker
+	 * that runs out of work steals from a random victim before going to sleep.
+	 *
+	 * Background tasks are only started when no foreground task is waiting, and at most all but one worker
+	 * runs them at any time so that foreground work always has a thread to run on.  A pool with a single
+	 * worker has no thread to spare: it starts a background task only when nothing else is queued, and
+	 * foreground work enqueued while one runs waits for it to finish.
+	 *
+	 * A pool can be given a capacity, the number of tasks that may be queued but not started.  Enqueueing
+	 * from outside the pool past the capacity either blocks until there is room or throws a
+	 * QueueFullException.  Tasks enqueued by a worker are never held back, since a worker waiting for its
+	 * own pool to make progress could deadlock it.
+	 *
+	 * A pinned pool splits its workers into one group per NUMA node and keeps each worker on the CPUs of
+	 * its node (PIN_NODE) or on a single CPU (PIN_CPU).  Idle workers steal from their own node first.
+	 * enqueueOnNode and enqueueOnWorker queue a task that only the workers of that node, or that one
+	 * worker, will run.  An unpinned pool is a single node.
+	 */
 	class ThreadPool {
 	public:
-		ThreadPool(size_t);
+		enum Priority { FOREGROUND, BACKGROUND };
+		enum Overflow { BLOCK, REJECT };
+		enum Affinity { UNPINNED, PIN_NODE, PIN_CPU };
+
+		ThreadPool(size_t, size_t = 0, Overflow = BLOCK, Affinity = UNPINNED);
 		template<class F, class... Args>
 		auto enqueue(F&& f, Args&&... args)
-			->std::future<typename std::result_of<F(Args...)>::type>;
+			->std::future<ResultOf<F, Args...>>;
+		template<class F, class... Args>
+		auto enqueueBackground(F&& f, Args&&... args)
+			->std::future<ResultOf<F, Args...>>;
+		template<class F, class... Args>
+		auto enqueueOnNode(size_t node, F&& f, Args&&... args)
+			->std::future<ResultOf<F, Args...>>;
+		template<class F, class... Args>
+		auto enqueueOnWorker(size_t worker, F&& f, Args&&... args)
+			->std::future<ResultOf<F, Args...>>;
+		template<class InputIt>
+		auto enqueueBulk(InputIt first, InputIt last, Priority = FOREGROUND)
+			->std::vector<std::future<ResultOf<typename std::iterator_traits<InputIt>::value_type>>>;
+		size_t workerCount() { return workers.size(); }
+		size_t nodeCount() { return groups.size(); }
+		size_t nodeOf(size_t worker) { return workers.at(worker)->node; }
+		ThreadPoolStats getStats();
+		void resetStats();
 		~ThreadPool();
 	private:
+		struct Worker {
+			WorkDeque deque;
+			std::thread thread;
+			uint32_t seed;
+			size_t node;
+			std::vector<unsigned> cpus;		// Empty if unpinned
+			std::deque<Task*> mailbox;		// Tasks for this worker only, under queue_mutex
+			std::atomic<size_t> mailed;
+
+			// statistics, written only by this worker (and resetStats)
+			std::atomic<uint64_t> submitted;
+			std::atomic<uint64_t> tasks;
+			std::atomic<uint64_t> steals;
+			std::atomic<uint64_t> busy;
+			std::atomic<uint64_t> idleTime;
+			std::atomic<uint64_t> idleSince;	// 0 unless asleep
+			HistogramRecorder depth;
+			HistogramRecorder wait;
+			HistogramRecorder run;
+
+			Worker() : seed(0), node(0), mailed(0), submitted(0), tasks(0), steals(0), busy(0), idleTime(0), idleSince(0) {}
+		};
+
+		struct Group {
+			std::vector<size_t> members;
+			std::deque<Task*> tasks;		// Tasks for this node only, under queue_mutex
+			std::atomic<size_t> queued;
+			Group() : queued(0) {}
+		};
+
+		struct Target {
+			enum Kind { ANY, NODE, WORKER } kind;
+			size_t index;
+		};
+
+		struct Context {
+			ThreadPool *pool;
+			size_t index;
+		};
+		static Context &current();
+
+		template<class F, class... Args>
+		auto make(Priority, Target, F&& f, Args&&... args)
+			->std::future<ResultOf<F, Args...>>;
+		void submit(Task **, size_t, Priority, Target);
+		void push(Task **, size_t, Priority, Target);
+		void discard(Task **, size_t);
+		Task *next(size_t);
+		Task *steal(size_t, bool);
+		void run(size_t);
+		void wake(size_t);
+		void released();
+		void execute(size_t, Task *);
+		void recordSubmit(Worker *, Task **, size_t);
+		static uint64_t now();
+		size_t depth() { return (size_t)pending + (size_t)pinned + (size_t)deferred; }
+		bool backgroundReady() {
+			return !background.empty() && (runningBackground < backgroundLimit ||
+				(backgroundLimit == 0 && runningBackground == 0 && pending == 0 && pinned == 0));
+		}
+		bool hasPinned(size_t self) { return workers[self]->mailed > 0 || groups[workers[self]->node]->queued > 0; }
+
 		// need to keep track of threads so we can join them
-		std::vector< std::thread > workers;
-		// the task queue
-		std::queue< std::function<void()> > tasks;
+		std::vector< std::unique_ptr<Worker> > workers;
+		std::vector< std::unique_ptr<Group> > groups;
+		// tasks enqueued from outside the pool
+		std::deque< Task* > tasks;
+		std::atomic<size_t> injected;
+		// background tasks, only touched under queue_mutex
+		std::deque< Task* > background;
+		std::atomic<size_t> deferred;	// Its size, changed under queue_mutex but read by depth() without it
+		size_t runningBackground;
+		size_t backgroundLimit;		// 0 for a single worker, which runs them only when otherwise idle
+
+		// bounds
+		const size_t capacity;			// 0 if unbounded
+		const Overflow overflow;
 
 		// synchronization
 		std::mutex queue_mutex;
 		std::condition_variable condition;
-		bool stop;
+		std::condition_variable space;	// Signalled when a bounded queue has room
+		std::atomic<int64_t> pending;	// Foreground tasks enqueued but not yet taken by a worker
+		std::atomic<int64_t> pinned;	// Node and worker tasks enqueued but not yet taken
+		std::atomic<int> idle;			// Workers waiting on the condition
+		std::atomic<int> blocked;		// Producers waiting for space
+		std::atomic<bool> stop;
+
+		// statistics for tasks enqueued from outside the pool, under queue_mutex
+		std::atomic<uint64_t> submitted;
+		std::atomic<uint64_t> rejected;
+		std::atomic<size_t> maxDepth;
+		HistogramRecorder depthRecorder;
 	};
 
+	// The pool and worker index of the calling thread, if it is a worker
+	inline ThreadPool::Context &ThreadPool::current() {
+		static thread_local Context context = { nullptr, 0 };
+		return context;
+	}
+
 	// the constructor just launches some amount of workers
-	inline ThreadPool::ThreadPool(size_t threads) : stop(false) {
-		for (size_t i = 0; i < threads; ++i) {
-			workers.emplace_back([this] {
-				while (true) {
-					std::function<void()> task;
-					std::unique_lock<std::mutex> lock(this->queue_mutex);
-					{
-						this->condition.wait(lock,
-							[this] { return this->stop || !this->tasks.empty(); });
-						if (this->stop && this->tasks.empty())
-							return;
-						task = std::move(this->tasks.front());
-						this->tasks.pop();
-					}
-					lock.unlock();
+	inline ThreadPool::ThreadPool(size_t threads, size_t capacity, Overflow overflow, Affinity affinity)
+		: injected(0), deferred(0), runningBackground(0), backgroundLimit(threads > 0 ? threads - 1 : 0),
+		capacity(capacity), overflow(overflow), pending(0), pinned(0), idle(0), blocked(0), stop(false),
+		submitted(0), rejected(0), maxDepth(0) {
+		std::vector< std::vector<unsigned> > topology;
+		if (affinity != UNPINNED) {
+			topology = numaTopology();
+			// Never make a node without workers
+			if (topology.size() > threads && threads > 0) {
+				topology.resize(threads);
+			}
+		} else {
+			topology.push_back(std::vector<unsigned>());
+		}
+		for (size_t n = 0; n < topology.size(); ++n) {
+			groups.emplace_back(new Group());
+		}
 
-					task();
-				}
-			});
+		// Every deque must exist before any worker starts stealing
+		for (size_t i = 0; i < threads; ++i) {
+			workers.emplace_back(new Worker());
+			Worker &worker = *workers.back();
+			worker.seed = (uint32_t)(i * 2654435761u + 1);
+			// Consecutive workers share a node
+			worker.node = i * topology.size() / threads;
+			Group &group = *groups[worker.node];
+			const std::vector<unsigned> &cpus = topology[worker.node];
+			if (affinity == PIN_CPU && !cpus.empty()) {
+				worker.cpus.push_back(cpus[group.members.size() % cpus.size()]);
+			} else if (affinity == PIN_NODE) {
+				worker.cpus = cpus;
+			}
+			group.members.push_back(i);
+		}
+		for (size_t i = 0; i < threads; ++i) {
+			workers[i]->thread = std::thread([this, i] { run(i); });
 		}
 	}
 
 	// add new work item to the pool
 	template<class F, class... Args>
-	auto ThreadPool::enqueue(F&& f, Args&&... args)-> std::future<typename std::result_of<F(Args...)>::type> {
-		using return_type = typename std::result_of<F(Args...)>::type;
+	auto ThreadPool::enqueue(F&& f, Args&&... args)-> std::future<ResultOf<F, Args...>> {
+		return make(FOREGROUND, Target{ Target::ANY, 0 }, std::forward<F>(f), std::forward<Args>(args)...);
+	}
 
-		auto task = std::make_shared< std::packaged_task<return_type()> >(
-			std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-			);
+	// add new work item that only runs when no foreground work is waiting
+	template<class F, class... Args>
+	auto ThreadPool::enqueueBackground(F&& f, Args&&... args)-> std::future<ResultOf<F, Args...>> {
+		return make(BACKGROUND, Target{ Target::ANY, 0 }, std::forward<F>(f), std::forward<Args>(args)...);
+	}
 
-		std::future<return_type> res = task->get_future();
-		{
-			std::unique_lock<std::mutex> lock(queue_mutex);
+	// add new work item that only the workers of the given node will run
+	template<class F, class... Args>
+	auto ThreadPool::enqueueOnNode(size_t node, F&& f, Args&&... args)-> std::future<ResultOf<F, Args...>> {
+		if (node >= groups.size()) {
+			throw std::out_of_range("ThreadPool has no such node");
+		}
+		return make(FOREGROUND, Target{ Target::NODE, node }, std::forward<F>(f), std::forward<Args>(args)...);
+	}
+
+	// add new work item that only the given worker will run
+	template<class F, class... Args>
+	auto ThreadPool::enqueueOnWorker(size_t worker, F&& f, Args&&... args)-> std::future<ResultOf<F, Args...>> {
+		if (worker >= workers.size()) {
+			throw std::out_of_range("ThreadPool has no such worker");
+		}
+		return make(FOREGROUND, Target{ Target::WORKER, worker }, std::forward<F>(f), std::forward<Args>(args)...);
+	}
+
+	template<class F, class... Args>
+	auto ThreadPool::make(Priority priority, Target target, F&& f, Args&&... args)-> std::future<ResultOf<F, Args...>> {
+		using return_type = ResultOf<F, Args...>;
+
+		std::packaged_task<return_type()> task(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+		std::future<return_type> res = task.get_future();
+		Task *t = new Task(std::move(task));
+		submit(&t, 1, priority, target);
+		return res;
+	}
+
+	// add a range of callables taking no arguments, taking the lock and waking the workers once for all of them
+	template<class InputIt>
+	auto ThreadPool::enqueueBulk(InputIt first, InputIt last, Priority priority)
+		->std::vector<std::future<ResultOf<typename std::iterator_traits<InputIt>::value_type>>> {
+		using return_type = ResultOf<typename std::iterator_traits<InputIt>::value_type>;
+
+		std::vector<std::future<return_type>> res;
+		std::vector<Task*> batch;
+		try {
+			for (; first != last; ++first) {
+				std::packaged_task<return_type()> task(*first);
+				res.push_back(task.get_future());
+				batch.push_back(new Task(std::move(task)));
+			}
+		} catch (...) {
+			discard(batch.data(), batch.size());
+			throw;
+		}
+		if (!batch.empty()) {
+			submit(batch.data(), batch.size(), priority, Target{ Target::ANY, 0 });
+		}
+		return res;
+	}
+
+	inline void ThreadPool::submit(Task **batch, size_t n, Priority priority, Target target) {
+		Context &context = current();
+		bool inside = context.pool == this;
+		// Node and worker tasks can wake any sleeper, so wake them all
+		size_t wakeups = target.kind != Target::ANY ? workers.size() : priority == FOREGROUND ? n : 1;
+
+		if (inside && priority == FOREGROUND && target.kind == Target::ANY) {
 			// don't allow enqueueing after stopping the pool
 			if (stop) {
+				discard(batch, n);
 				throw std::runtime_error("enqueue on stopped ThreadPool");
 			}
+			recordSubmit(workers[context.index].get(), batch, n);
+			// Counted before it is visible so that no worker sleeps while it is queued
+			pending += n;
+			for (size_t i = 0; i < n; ++i) {
+				workers[context.index]->deque.push(batch[i]);
+			}
+			wake(n);
+			return;
+		}
 
-			tasks.emplace([task]() { (*task)(); });
+		std::unique_lock<std::mutex> lock(queue_mutex);
+		// don't allow enqueueing after stopping the pool
+		if (stop) {
+			discard(batch, n);
+			throw std::runtime_error("enqueue on stopped ThreadPool");
+		}
+		if (capacity == 0 || inside) {
+			recordSubmit(inside ? workers[context.index].get() : nullptr, batch, n);
+			push(batch, n, priority, target);
+			lock.unlock();
+			wake(wakeups);
+			return;
+		}
+		if (overflow == REJECT && depth() + n > capacity) {
+			rejected += n;
+			discard(batch, n);
+			throw QueueFullException();
+		}
+
+		// Block until there is room, a batch larger than the capacity is queued as room frees up
+		size_t done = 0;
+		while (done < n) {
+			blocked++;
+			space.wait(lock, [this] { return stop || depth() < capacity; });
+			blocked--;
+			if (stop) {
+				discard(batch + done, n - done);
+				throw std::runtime_error("enqueue on stopped ThreadPool");
+			}
+			size_t room = (std::min)(n - done, capacity - depth());
+			recordSubmit(nullptr, batch + done, room);
+			push(batch + done, room, priority, target);
+			done += room;
+			lock.unlock();
+			wake((std::min)(wakeups, room));
+			lock.lock();
+		}
+	}
+
+	// Queue tasks from outside the deques, the caller holds queue_mutex
+	inline void ThreadPool::push(Task **batch, size_t n, Priority priority, Target target) {
+		if (target.kind == Target::WORKER) {
+			Worker &worker = *workers[target.index];
+			pinned += n;
+			worker.mailbox.insert(worker.mailbox.end(), batch, batch + n);
+			worker.mailed += n;
+		} else if (target.kind == Target::NODE) {
+			Group &group = *groups[target.index];
+			pinned += n;
+			group.tasks.insert(group.tasks.end(), batch, batch + n);
+			group.queued += n;
+		} else if (priority == FOREGROUND) {
+			pending += n;
+			tasks.insert(tasks.end(), batch, batch + n);
+			injected += n;
+		} else {
+			background.insert(background.end(), batch, batch + n);
+			deferred += n;
+		}
+	}
+
+	inline void ThreadPool::discard(Task **batch, size_t n) {
+		for (size_t i = 0; i < n; ++i) {
+			delete batch[i];
+		}
+	}
+
+	// Wake sleeping workers for n new tasks without holding the queue mutex
+	inline void ThreadPool::wake(size_t n) {
+		if (idle > 0) {
+			// A worker that saw no pending work is either waiting or about to wait once it has the mutex
+			{
+				std::lock_guard<std::mutex> lock(queue_mutex);
+			}
+			if (n > 1) {
+				condition.notify_all();
+			} else {
+				condition.notify_one();
+			}
+		}
+	}
+
+	// A queued task was taken, let a blocked producer in
+	inline void ThreadPool::released() {
+		if (blocked > 0) {
+			{
+				std::lock_guard<std::mutex> lock(queue_mutex);
+			}
+			space.notify_all();
+		}
+	}
+
+	// Find work for a worker: tasks for it or its node, its own deque, the shared queue, then a random victim
+	inline Task *ThreadPool::next(size_t self) {
+		Worker &me = *workers[self];
+		Task *task = nullptr;
+
+		if (hasPinned(self)) {
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			Group &group = *groups[me.node];
+			if (!me.mailbox.empty()) {
+				task = me.mailbox.front();
+				me.mailbox.pop_front();
+				me.mailed--;
+			} else if (!group.tasks.empty()) {
+				task = group.tasks.front();
+				group.tasks.pop_front();
+				group.queued--;
+			}
+			if (task != nullptr) {
+				pinned--;
+				lock.unlock();
+				released();
+				return task;
+			}
+		}
+
+		task = me.deque.pop();
+
+		if (task == nullptr && injected > 0) {
+			// Take a share of the shared queue so that the other workers can steal it without the mutex
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			size_t share = tasks.size() / workers.size() + 1;
+			for (size_t i = 0; i < share && !tasks.empty(); ++i) {
+				if (task == nullptr) {
+					task = tasks.front();
+				} else {
+					me.deque.push(tasks.front());
+				}
+				tasks.pop_front();
+				injected--;
+			}
+		}
+
+		if (task == nullptr && workers.size() > 1) {
+			// Stay on the same node if there is anything to take there
+			task = steal(self, true);
+			if (task == nullptr && groups.size() > 1) {
+				task = steal(self, false);
+			}
+			if (task != nullptr) {
+				me.steals.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		if (task != nullptr) {
+			pending--;
+			released();
+		}
+		return task;
+	}
+
+	// Steal from a random victim, on the worker's own node or on any other node
+	inline Task *ThreadPool::steal(size_t self, bool local) {
+		Worker &me = *workers[self];
+		// xorshift32
+		me.seed ^= me.seed << 13;
+		me.seed ^= me.seed >> 17;
+		me.seed ^= me.seed << 5;
+
+		const std::vector<size_t> &members = groups[me.node]->members;
+		size_t count = local ? members.size() : workers.size();
+		size_t start = me.seed % count;
+		Task *task = nullptr;
+		for (size_t i = 0; i < count && task == nullptr; ++i) {
+			size_t victim = local ? members[(start + i) % count] : (start + i) % count;
+			if (victim != self && (local || workers[victim]->node != me.node)) {
+				task = workers[victim]->deque.steal();
+			}
+		}
+		return task;
+	}
+
+	inline void ThreadPool::run(size_t self) {
+		current() = Context{ this, self };
+		pinCurrentThread(workers[self]->cpus);
+		while (true) {
+			Task *task = next(self);
+			if (task != nullptr) {
+				execute(self, task);
+				continue;
+			}
+
+			// Work is queued somewhere but another worker got to it first, try again without the mutex
+			if (pending > 0) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			if (backgroundReady()) {
+				task = background.front();
+				background.pop_front();
+				deferred--;
+				runningBackground++;
+				space.notify_all();
+				lock.unlock();
+				execute(self, task);
+				lock.lock();
+				runningBackground--;
+				// A worker held back by the limit may start the next one
+				if (backgroundReady() && idle > 0) {
+					condition.notify_one();
+				}
+				continue;
+			}
+			// Background tasks left over are drained by the workers already running them
+			if (stop && pending == 0 && !hasPinned(self)) {
+				return;
+			}
+			Worker &me = *workers[self];
+			me.idleSince.store(now(), std::memory_order_relaxed);
+			idle++;
+			condition.wait(lock,
+				[this, self] { return this->stop || this->pending > 0 || this->backgroundReady() || this->hasPinned(self); });
+			idle--;
+			// resetStats may have moved the start of the sleep forward
+			uint64_t slept = me.idleSince.exchange(0, std::memory_order_relaxed), woke = now();
+			me.idleTime.fetch_add(woke > slept ? woke - slept : 0, std::memory_order_relaxed);
+		}
+	}
+
+	inline uint64_t ThreadPool::now() {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Run and free a task, recording how long it waited and ran
+	inline void ThreadPool::execute(size_t self, Task *task) {
+		Worker &me = *workers[self];
+		uint64_t start = now();
+		me.wait.record(start > task->enqueued ? start - task->enqueued : 0);
+		(*task)();
+		delete task;
+		uint64_t elapsed = now() - start;
+		me.run.record(elapsed);
+		me.busy.fetch_add(elapsed, std::memory_order_relaxed);
+		me.tasks.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Stamp a batch about to be queued and count it, against the submitting worker or (under queue_mutex) the pool
+	inline void ThreadPool::recordSubmit(Worker *worker, Task **batch, size_t n) {
+		uint64_t stamp = now();
+		for (size_t i = 0; i < n; ++i) {
+			batch[i]->enqueued = stamp;
+		}
+		size_t queued = depth();
+		if (worker != nullptr) {
+			worker->submitted.fetch_add(n, std::memory_order_relaxed);
+			worker->depth.record(queued);
+		} else {
+			submitted.fetch_add(n, std::memory_order_relaxed);
+			depthRecorder.record(queued);
+		}
+		size_t high = maxDepth.load(std::memory_order_relaxed);
+		while (queued + n > high && !maxDepth.compare_exchange_weak(high, queued + n, std::memory_order_relaxed)) {
+		}
+	}
+
+	inline ThreadPoolStats ThreadPool::getStats() {
+		ThreadPoolStats stats;
+		uint64_t at = now();
+		stats.submitted = submitted.load(std::memory_order_relaxed);
+		stats.rejected = rejected.load(std::memory_order_relaxed);
+		stats.completed = 0;
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			stats.queueDepth = depth();
+			depthRecorder.snapshot(stats.depth);
+		}
+		stats.maxQueueDepth = maxDepth.load(std::memory_order_relaxed);
+		for (auto &worker : workers) {
+			WorkerStats w;
+			w.node = worker->node;
+			w.tasks = worker->tasks.load(std::memory_order_relaxed);
+			w.steals = worker->steals.load(std::memory_order_relaxed);
+			w.busyNanos = worker->busy.load(std::memory_order_relaxed);
+			w.idleNanos = worker->idleTime.load(std::memory_order_relaxed);
+			// Count the current sleep too
+			uint64_t since = worker->idleSince.load(std::memory_order_relaxed);
+			if (since != 0 && at > since) {
+				w.idleNanos += at - since;
+			}
+			stats.submitted += worker->submitted.load(std::memory_order_relaxed);
+			stats.completed += w.tasks;
+			worker->depth.snapshot(stats.depth);
+			worker->wait.snapshot(stats.wait);
+			worker->run.snapshot(stats.run);
+			stats.workers.push_back(w);
+		}
+		return stats;
+	}
+
+	// Zero the counters.  Updates racing with the reset may be lost.
+	inline void ThreadPool::resetStats() {
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		submitted = 0;
+		rejected = 0;
+		maxDepth = depth();
+		depthRecorder.reset();
+		uint64_t at = now();
+		for (auto &worker : workers) {
+			worker->submitted = 0;
+			worker->tasks = 0;
+			worker->steals = 0;
+			worker->busy = 0;
+			worker->idleTime = 0;
+			// A sleeping worker only counts the part of its sleep after the reset
+			uint64_t since = worker->idleSince.load(std::memory_order_relaxed);
+			if (since != 0) {
+				worker->idleSince.compare_exchange_strong(since, at, std::memory_order_relaxed);
+			}
+			worker->depth.reset();
+			worker->wait.reset();
+			worker->run.reset();
 		}
-		condition.notify_one();
-		return res;
 	}
 
 	// the destructor joins all threads
@@ -85,9 +1050,10 @@ namespace THREADING {
 			stop = true;
 		}
 		condition.notify_all();
-		for (std::thread &worker : workers) {
-			worker.join();
+		space.notify_all();
+		for (auto &worker : workers) {
+			worker->thread.join();
 		}
 	}
 }
-#endif
\ No newline at end of file
+#endif
@@ -19,10 +19,13 @@ enum JsonTag {
     JSON_OBJECT,
     JSON_TRUE,
     JSON_FALSE,
+    JSON_SLICE,
+    JSON_INTEGER,
     JSON_NULL = 0xF
 };
 
 struct JsonNode;
+struct JsonSlice;
 
 #define JSON_VALUE_PAYLOAD_MASK 0x00007FFFFFFFFFFFULL
 #define JSON_VALUE_NAN_MASK 0x7FF8000000000000ULL
@@ -62,6 +65,23 @@ union JsonValue {
         assert(getTag() == JSON_ARRAY || getTag() == JSON_OBJECT);
         return (JsonNode *)getPayload();
     }
+    JsonSlice *toSlice() const {
+        assert(getTag() == JSON_SLICE);
+        return (JsonSlice *)getPayload();
+    }
+    // Integers are only tagged when a double cannot hold them exactly (beyond 2^53), others are numbers
+    int64_t toInteger() const {
+        assert(getTag() == JSON_INTEGER);
+        return *(int64_t *)getPayload();
+    }
+};
+
+// A string left in the input by jsonParseView: length bytes at data, without a terminator.  A \u0000 escape
+// stays in the slice (and in a tape encoded from it) and counts towards length, whereas jsonParse decodes strings
+// in place as C strings, so they end at the first \u0000.
+struct JsonSlice {
+    const char *data;
+    size_t length;
 };
 
 struct JsonNode {
@@ -105,7 +125,10 @@ inline JsonIterator end(JsonValue) {
     XX(UNEXPECTED_CHARACTER, "unexpected character") \
     XX(UNQUOTED_KEY, "unquoted key")                 \
     XX(BREAKING_BAD, "breaking bad")                 \
-    XX(ALLOCATION_FAILURE, "allocation failure")
+    XX(ALLOCATION_FAILURE, "allocation failure")     \
+    XX(BAD_TAPE, "bad tape")                         \
+    XX(BAD_PATH, "bad path")                         \
+    XX(NOT_FOUND, "not found")
 
 enum JsonErrno {
 #define XX(no, str) JSON_##no,
@@ -115,12 +138,24 @@ enum JsonErrno {
 
 JSON_API const char *jsonStrError(int err);
 
+// Arena for parsed values.  deallocate() frees every zone, while reset() keeps them for the next document: if
+// the last document needed more than one zone they are replaced by a single zone big enough for it, so an
+// allocator that is reset between documents of similar size stops calling malloc altogether.
 class JSON_API JsonAllocator {
 
     struct Zone {
         Zone *next;
         size_t used;
+        size_t size;
     } *head = nullptr;
+    size_t zoneSize;
+    size_t peak;
+
+    struct Index;
+    struct Registry;
+    Registry *registry = nullptr;
+
+    friend JSON_API JsonNode *jsonFind(JsonValue object, const char *key, JsonAllocator &allocator);
 
 public:
     JsonAllocator(void);
@@ -129,6 +164,108 @@ public:
 	~JsonAllocator();
     void *allocate(size_t size);
     void deallocate();
+    void reset();
 };
 
+// Deepest nesting of arrays and objects that the parsers (and the tape decoder) accept
+#ifndef JSON_DEPTH_MAX
+#define JSON_DEPTH_MAX 1024
+#endif
+
 JSON_API int jsonParse(char *str, char **endptr, JsonValue *value, JsonAllocator &allocator);
+
+// Find the first member of an object named key, or nullptr.  Objects with more than JSON_INDEX_MIN members get a
+// hash index in the allocator the first time they are searched, so later lookups do not scan the member list.
+// The index lives until the allocator is reset, and does not see members added or removed after it was built.
+#define JSON_INDEX_MIN 16
+JSON_API JsonNode *jsonFind(JsonValue object, const char *key, JsonAllocator &allocator);
+
+// Parse size bytes (or up to a NUL) without writing to them.  String values are JSON_SLICE, pointing into str
+// unless they contain escapes, which are decoded into the allocator.  Keys are copied into the allocator.
+JSON_API int jsonParseView(const char *str, size_t size, const char **endptr, JsonValue *value, JsonAllocator &allocator);
+
+// Binary tape: a parsed document in a compact, position independent form (numbers in host byte order) that
+// is turned back into a JsonValue without tokenizing.  Containers record their size so that readers can skip
+// them, and strings are stored unescaped and NUL terminated so that the decoded value points into the tape.
+#define JSON_TAPE_MAGIC "GSNTAPE1"
+#define JSON_TAPE_MAGIC_SIZE 8
+
+JSON_API size_t jsonTapeSize(JsonValue value);
+JSON_API size_t jsonTapeEncode(JsonValue value, char *out);
+JSON_API bool jsonIsTape(const char *data, size_t size);
+JSON_API int jsonTapeDecode(char *tape, size_t size, JsonValue *value, JsonAllocator &allocator);
+
+// Lazy access to JSON text or a tape, without writing to it.  find() walks to the value at a path such as
+// "a.b[3].c", skipping the subtrees it passes over without parsing (or validating) them, and parse() builds only
+// the value that was found.  Keys containing '.' or '[' cannot be named in a path.
+class JSON_API JsonCursor {
+    const char *data;
+    size_t size;
+    bool tape;
+
+public:
+    JsonCursor(void);
+    JsonCursor(const char *data, size_t size);
+    int find(const char *path, JsonCursor *found) const;
+    int parse(JsonValue *value, JsonAllocator &allocator) const;
+    const char *begin() const {
+        return data;
+    }
+    const char *end() const {
+        return data + size;
+    }
+};
+
+// Growable output buffer for jsonStringify.  clear() keeps the memory, so a buffer reused across documents stops
+// allocating once it has grown to fit them.
+class JSON_API JsonBuffer {
+    char *buffer;
+    size_t length;
+    size_t capacity;
+
+public:
+    JsonBuffer(void);
+    JsonBuffer(JsonBuffer &&x);
+    JsonBuffer &operator=(JsonBuffer &&x);
+    ~JsonBuffer();
+    const char *data() const {
+        return buffer;
+    }
+    size_t size() const {
+        return length;
+    }
+    void clear() {
+        length = 0;
+    }
+    // Room for at least n bytes after size(), or nullptr if it cannot be allocated
+    char *reserve(size_t n);
+    void resize(size_t size) {
+        assert(size <= capacity);
+        length = size;
+    }
+};
+
+// Append a value to out as compact JSON text that jsonParse reads back to the same value.  Doubles are written
+// with the fewest digits that round trip (non-finite ones, which JSON cannot represent, as null).  Returns
+// JSON_OK or JSON_ALLOCATION_FAILURE.
+JSON_API int jsonStringify(JsonValue value, JsonBuffer &out);
+
+// A change to JSON text or a tape: replace the length bytes at offset with the size bytes at data.  Lists of
+// edits are sorted by offset and never overlap.
+struct JsonEdit {
+    JsonEdit *next;
+    size_t offset;
+    size_t length;
+    const char *data;
+    size_t size;
+};
+
+// Work out the edits that apply an RFC 7386 merge patch to a document (text or tape), visiting only the members
+// the patch names.  Text edits that would shrink the document are padded with spaces, so that they overwrite
+// their bytes in place; tape edits are exact and include the new sizes of the containers they change.  The
+// edits and their data live in the allocator, and the parts of the document that are skipped are not validated.
+JSON_API int jsonMergePatch(const char *data, size_t size, JsonValue patch, JsonEdit **edits, JsonAllocator &allocator);
+
+// The edits that set the value at a path (as for JsonCursor::find), adding the last member if the object it
+// names does not have it yet
+JSON_API int jsonSetPath(const char *data, size_t size, const char *path, JsonValue value, JsonEdit **edits, JsonAllocator &allocator);